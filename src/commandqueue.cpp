@@ -0,0 +1,62 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "commandqueue.hpp"
+
+using namespace p44;
+
+
+// MARK: ===== CommandQueue
+
+CommandQueue::CommandQueue() :
+  head(0),
+  tail(0)
+{
+}
+
+
+bool CommandQueue::push(SimpleCB aCommand)
+{
+  unsigned t = tail.load(std::memory_order_relaxed);
+  if (t-head.load(std::memory_order_acquire)>=queueSize) {
+    return false; // full
+  }
+  commands[t%queueSize] = aCommand;
+  // publish the command to the consumer
+  tail.store(t+1, std::memory_order_release);
+  return true;
+}
+
+
+int CommandQueue::executeQueued()
+{
+  int n = 0;
+  unsigned h = head.load(std::memory_order_relaxed);
+  while (h!=tail.load(std::memory_order_acquire)) {
+    SimpleCB cmd;
+    cmd.swap(commands[h%queueSize]); // leaves the slot empty
+    // slot can be re-used by the producer now
+    head.store(++h, std::memory_order_release);
+    cmd();
+    n++;
+  }
+  return n;
+}
@@ -0,0 +1,62 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __lethd_commandqueue_hpp__
+#define __lethd_commandqueue_hpp__
+
+#include "p44utils_common.hpp"
+
+#include <atomic>
+
+namespace p44 {
+
+  /// Lock-free queue to pass commands (callbacks) from one thread (the producer) to another
+  /// thread (the consumer) which executes them
+  /// @note works for exactly one producer and one consumer thread
+  class CommandQueue : public P44Obj
+  {
+    static const unsigned queueSize = 256; ///< max number of commands waiting
+
+    SimpleCB commands[queueSize];
+    std::atomic<unsigned> head; ///< index of next command to execute (only written by consumer)
+    std::atomic<unsigned> tail; ///< index of next free slot (only written by producer)
+
+  public:
+
+    CommandQueue();
+
+    /// queue a command for execution
+    /// @param aCommand the command to queue
+    /// @return false if the queue is full and the command could not be queued
+    /// @note must only be called from the producer thread
+    bool push(SimpleCB aCommand);
+
+    /// execute all queued commands
+    /// @return number of commands executed
+    /// @note must only be called from the consumer thread
+    int executeQueued();
+
+  };
+  typedef boost::intrusive_ptr<CommandQueue> CommandQueuePtr;
+
+} // namespace p44
+
+#endif /* __lethd_commandqueue_hpp__ */
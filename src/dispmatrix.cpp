@@ -21,6 +21,7 @@
 
 #include "dispmatrix.hpp"
 #include "application.hpp"
+#include "crc32.hpp"
 
 
 #define LED_MODULE_COLS 74
@@ -28,60 +29,89 @@
 #define LED_MODULE_BORDER_LEFT 1
 #define LED_MODULE_BORDER_RIGHT 1
 
+#define STATS_WINDOW 500 // number of most recent frames statistics are calculated over
+#define DEFAULT_REFRESH_INTERVAL (100*MilliSecond) // default interval for refreshing unchanged LED chains
+#define LED_CHANNEL_MILLIAMPS 20 // WS281x: current of one color channel at full brightness
+#define LED_IDLE_MILLIAMPS 1 // WS281x: current of one LED when off
+#define POWER_LIMIT_HYSTERESIS 4 // power limit is raised only when it can be raised by more than this
+
 
 using namespace p44;
 
 
 // MARK: ===== DispPanel
 
-DispPanel::DispPanel(const string aChainName, int aOffsetX, int aRows, int aCols, int aBorderLeft, int aBorderRight, int aOrientation) :
+DispPanel::DispPanel(const string aOutputSpec, int aOffsetX, int aOffsetY, int aRows, int aCols, int aBorderLeft, int aBorderRight, int aOrientation, ViewPtr aContent, MLMicroSeconds aRefreshInterval, LEDMappingPtr aMapping) :
   offsetX(aOffsetX),
+  offsetY(aOffsetY),
   rows(aRows),
   cols(aCols),
   borderLeft(aBorderLeft),
   borderRight(aBorderRight),
   orientation(aOrientation),
-  lastUpdate(Never)
+  lastUpdate(Never),
+  refreshInterval(aRefreshInterval),
+  frameDirty(zeroRect),
+  calibrationChanged(false),
+  outputPending(false),
+  colorCurrent(0),
+  renderTimes(STATS_WINDOW, RollingHistogram::timeLimits, RollingHistogram::numTimeLimits, MilliSecond),
+  showTimes(STATS_WINDOW, RollingHistogram::timeLimits, RollingHistogram::numTimeLimits, MilliSecond),
+  skippedFrames(0)
 {
-  // create chain driver
-  chain = LEDChainCommPtr(new LEDChainComm(LEDChainComm::ledtype_ws281x, aChainName, rows*cols, cols, false, true));
-  chain->begin();
-  // create views
-  message = TextViewPtr(new TextView);
-  message->setFrame(0, 0, 2000, 7);
-  message->setBackGroundColor(transparent);
-  message->setWrapMode(View::wrapX);
+  int visibleCols = cols-borderLeft-borderRight;
+  // LED mapping
+  mapping = aMapping;
+  if (!mapping) {
+    // standard module: serpentine rows, hidden LEDs at both ends of every row
+    mapping = LEDMappingPtr(new LEDMapping(visibleCols, rows));
+    mapping->addModule(-borderRight, 0, cols, rows, LEDMapping::serpentine);
+  }
+  // create output
+  output = LEDOutput::newOutput(aOutputSpec, mapping->getNumLeds());
+  output->begin();
+  ledColors.resize(3*mapping->getNumLeds(), 0);
+  calibratedColors.resize(ledColors.size(), 0);
+  // create view
   dispView = ViewScrollerPtr(new ViewScroller);
-  dispView->setFrame(0, 0, cols-borderLeft-borderRight, rows);
+  dispView->setFrame(0, 0, visibleCols, rows);
   dispView->setFullFrameContent();
   dispView->setOrientation(orientation);
   dispView->setBackGroundColor(black); // not transparent!
-  dispView->setScrolledView(message);
+  dispView->setScrolledView(aContent);
+  frame.resize(visibleCols*rows, premultBlack);
+  // chain starts out black, like the back buffer
+  rowHashes.resize(rows, rowHash(0));
   // position main view
   dispView->setOffsetX(offsetX);
-  LOG(LOG_NOTICE, "- created panel with %d cols total (%d visible), %d rows, at offsetX %d, orientation %d, border left %d, right %d", cols, cols-borderLeft-borderRight, rows, offsetX, orientation, borderLeft, borderRight);
+  dispView->setOffsetY(offsetY);
+  LOG(LOG_NOTICE, "- created panel with %d cols total (%d visible), %d rows, %d LEDs, at offsetX %d, offsetY %d, orientation %d, border left %d, right %d", cols, visibleCols, rows, mapping->getNumLeds(), offsetX, offsetY, orientation, borderLeft, borderRight);
   // show operation status: dim green in first LED (if invisible), dim blue in last LED (if invisible)
-  if (borderLeft>0) {
-    chain->setColorXY(0, 0, 0, 100, 0);
-  }
-  if (borderRight>0) {
-    chain->setColorXY(cols-1, rows-1, 0, 0, 100);
+  int last = mapping->getNumLeds()-1;
+  if (last>0) {
+    if (mapping->pixelIndex(0)<0) {
+      ledColors[1] = 100;
+    }
+    if (mapping->pixelIndex(last)<0) {
+      ledColors[3*last+2] = 100;
+    }
+    colorCurrent = calibration.apply(&ledColors[0], &calibratedColors[0], mapping->getNumLeds())*LED_CHANNEL_MILLIAMPS/255;
+    output->setColors(0, mapping->getNumLeds(), &calibratedColors[0]);
   }
-  chain->show();
+  output->show();
 }
 
 
 DispPanel::~DispPanel()
 {
-  chain->clear();
-  chain->show();
-  chain->end();
+  output->clear();
+  output->show();
+  output->end();
 }
 
 
 
 #define MAX_STEP_INTERVAL (20*MilliSecond)
-#define MAX_UPDATE_INTERVAL (100*MilliSecond)
 
 MLMicroSeconds DispPanel::step()
 {
@@ -90,55 +120,151 @@ MLMicroSeconds DispPanel::step()
     do {
       nextCall = dispView->step();
     } while (nextCall==0);
-    updateDisplay();
   }
   return nextCall;
 }
 
 
-void DispPanel::updateDisplay()
+void DispPanel::render()
 {
-  if (dispView) {
-    bool dirty = dispView->isDirty();
-    MLMicroSeconds now = MainLoop::now();
-    if (dirty || now>lastUpdate+MAX_UPDATE_INTERVAL) {
-      lastUpdate = now;
-      if (dirty) {
-        // update LED chain content buffer
-        for (int x=borderRight; x<cols-borderLeft; x++) {
-          for (int y=0; y<rows; y++) {
-            PixelColor p = dispView->colorAt(x-borderRight, y);
-            PixelColor dp = dimmedPixel(p, p.a);
-            chain->setColorXY(x, y, dp.r, dp.g, dp.b);
-          }
-        }
-        dispView->updated();
+  if (dispView && dispView->isDirty()) {
+    MLMicroSeconds start = MainLoop::now();
+    // render changed area into back buffer, row by row
+    int visibleCols = cols-borderLeft-borderRight;
+    PixelRect visible = { .x=0, .y=0, .dx=visibleCols, .dy=rows };
+    PixelRect r = intersectRect(dispView->dirtyRect(), visible);
+    if (!rectIsEmpty(r)) {
+      for (int y=r.y; y<r.y+r.dy; y++) {
+        // premultiplied colors are what the LEDs need to show
+        dispView->premultipliedRowColorsAt(r.x, y, r.dx, &frame[y*visibleCols+r.x]);
       }
-      // update hardware (refresh actual LEDs, cleans away possible glitches
-      chain->show();
+      frameDirty = unionRect(frameDirty, r);
+    }
+    renderTimes.add(MainLoop::now()-start);
+  }
+}
+
+
+void DispPanel::updated()
+{
+  // Note: also marks the shared content updated, so this must not happen before all panels are rendered
+  if (dispView) dispView->updated();
+}
+
+
+uint32_t DispPanel::rowHash(int aY)
+{
+  // only the colors make it to the LEDs
+  Crc32 crc;
+  int visibleCols = cols-borderLeft-borderRight;
+  const PremultPixelColor *p = &frame[aY*visibleCols];
+  for (int x=0; x<visibleCols; ++x, ++p) {
+    crc.addByte(p->r);
+    crc.addByte(p->g);
+    crc.addByte(p->b);
+  }
+  return crc.getCRC();
+}
+
+
+void DispPanel::prepareOutput()
+{
+  bool changed = false;
+  if (!rectIsEmpty(frameDirty)) {
+    // check if changed rows actually differ from what the chain shows
+    for (int y=frameDirty.y; y<frameDirty.y+frameDirty.dy; y++) {
+      uint32_t h = rowHash(y);
+      if (h==rowHashes[y]) continue; // rendered again, but same as on the chain already
+      rowHashes[y] = h;
+      changed = true;
     }
+    frameDirty = zeroRect;
+    if (changed) {
+      // transfer back buffer to LED colors in a single pass over the mapping
+      mapping->mapCanvas((const uint8_t *)&frame[0], sizeof(PremultPixelColor), &ledColors[0]);
+    }
+    else {
+      skippedFrames++;
+    }
+  }
+  if (changed || calibrationChanged) {
+    // calibrate, estimating current on the way
+    colorCurrent = calibration.apply(&ledColors[0], &calibratedColors[0], mapping->getNumLeds())*LED_CHANNEL_MILLIAMPS/255;
+    calibrationChanged = false;
+    outputPending = true;
   }
 }
 
 
-void DispPanel::setOffsetX(double aOffsetX)
+int DispPanel::getUnlimitedColorCurrent()
 {
-  if (dispView) dispView->setOffsetX(aOffsetX+offsetX);
+  uint8_t l = calibration.getPowerLimit();
+  return l>0 ? colorCurrent*255/l : colorCurrent;
 }
 
 
-void DispPanel::setText(const string aText)
+int DispPanel::getIdleCurrent()
+{
+  return mapping->getNumLeds()*LED_IDLE_MILLIAMPS;
+}
+
+
+void DispPanel::setPowerLimit(uint8_t aPowerLimit)
+{
+  if (calibration.setPowerLimit(aPowerLimit)) calibrationChanged = true;
+}
+
+
+void DispPanel::present()
+{
+  MLMicroSeconds now = MainLoop::now();
+  bool changed = outputPending;
+  if (outputPending) {
+    output->setColors(0, mapping->getNumLeds(), &calibratedColors[0]);
+    outputPending = false;
+  }
+  if (changed || (refreshInterval!=Never && now>lastUpdate+refreshInterval)) {
+    lastUpdate = now;
+    // update hardware (refresh actual LEDs, cleans away possible glitches
+    output->show();
+    showTimes.add(MainLoop::now()-now);
+  }
+}
+
+
+JsonObjectPtr DispPanel::stats(bool aReset)
+{
+  JsonObjectPtr s = JsonObject::newObj();
+  s->add("rendertime", renderTimes.json());
+  s->add("showtime", showTimes.json());
+  s->add("skippedframes", JsonObject::newInt64(aReset ? skippedFrames.exchange(0) : skippedFrames.load()));
+  if (aReset) {
+    renderTimes.reset();
+    showTimes.reset();
+  }
+  return s;
+}
+
+
+void DispPanel::setBrightness(uint8_t aBrightness)
+{
+  if (calibration.setBrightness(aBrightness)) calibrationChanged = true;
+}
+
+
+void DispPanel::setColorCorrection(double aGamma, double aRed, double aGreen, double aBlue)
+{
+  calibration.setGamma(aGamma);
+  calibration.setWhiteBalance(aRed, aGreen, aBlue);
+  calibrationChanged = true;
+}
+
+
+void DispPanel::setScrollOffsets(double aOffsetX, double aOffsetY)
 {
   if (dispView) {
-    // due to offset wraparound according to scrolled view's content size (~=text length)
-    // current offset might be smaller than panel's offsetX right now. This must be
-    // adjusted BEFORE content size changes
-    double ox = dispView->getOffsetX();
-    double cx = dispView->getScrolledView()->getContentSizeX();
-    while (cx>0 && ox<offsetX) ox += cx;
-    dispView->setOffsetX(ox);
-    // now we can set new text (and content size)
-    if (message) message->setText(aText);
+    dispView->setOffsetX(aOffsetX+offsetX);
+    dispView->setOffsetY(aOffsetY+offsetY);
   }
 }
 
@@ -150,12 +276,44 @@ void DispPanel::setText(const string aText)
 
 DispMatrix::DispMatrix(const string aChainName1, const string aChainName2, const string aChainName3) :
   inherited("text"),
-  usedPanels(0)
+  refreshInterval(DEFAULT_REFRESH_INTERVAL),
+  powerBudget(0),
+  powerLimit(255),
+  estimatedCurrent(0),
+  brightness(255),
+  targetBrightness(-1),
+  fadeDist(0),
+  fadeStartTime(Never),
+  fadeTime(0),
+  renderThreads(0),
+  nextFrameAt(Never),
+  stepLateness(STATS_WINDOW, RollingHistogram::timeLimits, RollingHistogram::numTimeLimits, MilliSecond),
+  frameTimes(STATS_WINDOW, RollingHistogram::timeLimits, RollingHistogram::numTimeLimits, MilliSecond),
+  caughtUpSteps(STATS_WINDOW, RollingHistogram::countLimits, RollingHistogram::numCountLimits, 1),
+  lastCaughtUpSteps(0),
+  useRenderThread(false),
+  renderThreadRunning(false),
+  stopRendering(false)
 {
+  commandQueue = CommandQueuePtr(new CommandQueue);
+  pthread_mutex_init(&statusMutex, NULL);
+  publishedStatus.hasMessage = false;
+  publishedStatus.hasDispView = false;
+  createContent();
   // save chain names
   chainNames[0] = aChainName1;
   chainNames[1] = aChainName2;
   chainNames[2] = aChainName3;
+  // check for glitch refresh
+  int ms;
+  if (CmdLineApp::sharedCmdLineApp()->getIntOption("refreshinterval", ms)) {
+    refreshInterval = ms>0 ? ms*MilliSecond : Never;
+  }
+  // check for power budget
+  CmdLineApp::sharedCmdLineApp()->getIntOption("powerbudget", powerBudget);
+  // check for parallel rendering
+  CmdLineApp::sharedCmdLineApp()->getIntOption("renderthreads", renderThreads);
+  useRenderThread = CmdLineApp::sharedCmdLineApp()->getOption("renderthread")!=NULL;
   // check for commandline-triggered standalone operation
   string cfg;
   if (CmdLineApp::sharedCmdLineApp()->getStringOption("dispmatrix", cfg)) {
@@ -163,12 +321,11 @@ DispMatrix::DispMatrix(const string aChainName1, const string aChainName2, const
     int numRows = LED_MODULE_ROWS;
     sscanf(cfg.c_str(), "%d,%d", &numCols, &numRows);
     // instantiate a single panel
-    panels[usedPanels] = DispPanelPtr(new DispPanel(chainNames[usedPanels], 0, numRows, numCols, LED_MODULE_BORDER_LEFT, LED_MODULE_BORDER_RIGHT, View::right));
-    usedPanels++;
-    initOperation();
+    panels.push_back(DispPanelPtr(new DispPanel(chainNames[0], 0, 0, numRows, numCols, LED_MODULE_BORDER_LEFT, LED_MODULE_BORDER_RIGHT, View::right, message, refreshInterval, LEDMappingPtr())));
     // have standard message scrolling
-    panels[0]->setText("Hello World +++ ");
-    panels[0]->dispView->startScroll(0.25, 0, 20*MilliSecond, true);
+    message->setText("Hello World +++ ");
+    scroller->startScroll(0.25, 0, 20*MilliSecond, true);
+    initOperation();
   }
 }
 
@@ -176,17 +333,36 @@ DispMatrix::DispMatrix(const string aChainName1, const string aChainName2, const
 void DispMatrix::reset()
 {
   stepTicket.cancel();
-  for (int i=0; i<usedPanels; ++i) {
-    panels[i].reset();
-  }
-  usedPanels = 0;
+  stopRenderThread();
+  nextFrameAt = Never;
+  renderPool.reset();
+  panels.clear();
+  // new panels start with fresh content, text and scroll settings are not kept from previous init
+  createContent();
+  lastCaughtUpSteps = 0;
+  brightness = 255;
+  targetBrightness = -1;
+  powerLimit = 255;
+  estimatedCurrent = 0;
   inherited::reset();
 }
 
 
+void DispMatrix::createContent()
+{
+  message = TextViewPtr(new TextView);
+  message->setFrame(0, 0, 2000, 7);
+  message->setBackGroundColor(transparent);
+  message->setWrapMode(View::wrapX);
+  scroller = ViewScrollerPtr(new ViewScroller);
+  scroller->setScrolledView(message);
+}
+
+
 DispMatrix::~DispMatrix()
 {
   reset();
+  pthread_mutex_destroy(&statusMutex);
 }
 
 
@@ -200,6 +376,7 @@ ErrorPtr DispMatrix::initialize(JsonObjectPtr aInitData)
   if (!aInitData->isType(json_type_array)) {
     return LethdApiError::err("init data must be array of panel specs");
   }
+  int canvasRows = 7; // rows of the text
   for (int i = 0; i<aInitData->arrayLength(); ++i) {
     JsonObjectPtr panelCfg = aInitData->arrayGet(i);
     int rows = LED_MODULE_ROWS;
@@ -208,6 +385,7 @@ ErrorPtr DispMatrix::initialize(JsonObjectPtr aInitData)
     int borderRight = LED_MODULE_BORDER_RIGHT;
     int orientation = View::right;
     int offsetX = 0;
+    int offsetY = 0;
     // configure
     JsonObjectPtr o;
     // - usually
@@ -220,6 +398,10 @@ ErrorPtr DispMatrix::initialize(JsonObjectPtr aInitData)
     if (panelCfg->get("offset", o, true)) {
       offsetX = o->int32Value();
     }
+    if (panelCfg->get("offsety", o, true)) {
+      // panels can be tiled in two dimensions
+      offsetY = o->int32Value();
+    }
     // - special cases
     if (panelCfg->get("rows", o, true)) {
       rows = o->int32Value();
@@ -230,43 +412,129 @@ ErrorPtr DispMatrix::initialize(JsonObjectPtr aInitData)
     if (panelCfg->get("borderright", o, true)) {
       borderRight = o->int32Value();
     }
-    // now create panel
-    if (usedPanels>=numChains) {
-      return LethdApiError::err("cannot create more than %d display panels", numChains);
+    // - LED calibration
+    double gamma = 1;
+    double wb[3] = { 1, 1, 1 };
+    if (panelCfg->get("gamma", o, true)) {
+      gamma = o->doubleValue();
+    }
+    if (panelCfg->get("whitebalance", o, true)) {
+      if (!o->isType(json_type_array) || o->arrayLength()!=3) {
+        return LethdApiError::err("panel #%d: whitebalance must be array of red, green and blue factors", i);
+      }
+      for (int c=0; c<3; ++c) wb[c] = o->arrayGet(c)->doubleValue();
     }
+    // - odd shaped panels: explicit LED mapping, which includes hidden LEDs
+    LEDMappingPtr mapping;
+    if (panelCfg->get("mapping", o, true)) {
+      mapping = LEDMappingPtr(new LEDMapping(visiblecols, rows));
+      ErrorPtr err = addMappingFromConfig(mapping, o, visiblecols, rows);
+      if (!Error::isOK(err)) {
+        return LethdApiError::err("panel #%d: %s", i, err->description().c_str());
+      }
+      borderLeft = 0;
+      borderRight = 0;
+    }
+    // - output: LED chain device or other output spec, defaults to ledchainN command line option for the first panels
+    string outputSpec;
+    if (panelCfg->get("output", o, true)) {
+      outputSpec = o->stringValue();
+    }
+    else if (i<numDefaultChains) {
+      outputSpec = chainNames[i];
+    }
+    else {
+      return LethdApiError::err("panel #%d: no output specified", i);
+    }
+    // now create panel
     int cols = visiblecols+borderLeft+borderRight;
-    panels[usedPanels] = DispPanelPtr(new DispPanel(chainNames[usedPanels], offsetX, rows, cols, borderLeft, borderRight, orientation));
-    usedPanels++;
+    DispPanelPtr panel = DispPanelPtr(new DispPanel(outputSpec, offsetX, offsetY, rows, cols, borderLeft, borderRight, orientation, message, refreshInterval, mapping));
+    panel->setColorCorrection(gamma, wb[0], wb[1], wb[2]);
+    panel->setBrightness(brightness);
+    panels.push_back(panel);
+    if (offsetY+rows>canvasRows) canvasRows = offsetY+rows;
   }
+  // content must cover the entire canvas, so the background color extends over all tiles
+  message->setFrame(0, 0, 2000, canvasRows);
   initOperation();
   return Error::ok();
 }
 
 
+ErrorPtr DispMatrix::addMappingFromConfig(LEDMappingPtr aMapping, JsonObjectPtr aConfig, int aCanvasDx, int aCanvasDy)
+{
+  if (!aConfig || !aConfig->isType(json_type_array)) {
+    return TextError::err("LED mapping must be array of modules");
+  }
+  for (int i=0; i<aConfig->arrayLength(); ++i) {
+    JsonObjectPtr m = aConfig->arrayGet(i);
+    if (!m || !m->isType(json_type_object)) {
+      return TextError::err("LED mapping module #%d must be an object", i);
+    }
+    JsonObjectPtr o;
+    if (m->get("gap", o, true)) {
+      aMapping->addGap(o->int32Value());
+      continue;
+    }
+    int x = 0;
+    int y = 0;
+    int dx = aCanvasDx;
+    int dy = aCanvasDy;
+    LEDMapping::ModuleFlags flags = 0;
+    if (m->get("x", o, true)) x = o->int32Value();
+    if (m->get("y", o, true)) y = o->int32Value();
+    if (m->get("dx", o, true)) dx = o->int32Value();
+    if (m->get("dy", o, true)) dy = o->int32Value();
+    if (m->get("columns", o, true) && o->boolValue()) flags |= LEDMapping::columns;
+    if (m->get("serpentine", o, true) && o->boolValue()) flags |= LEDMapping::serpentine;
+    if (m->get("mirrorx", o, true) && o->boolValue()) flags |= LEDMapping::mirrorX;
+    if (m->get("mirrory", o, true) && o->boolValue()) flags |= LEDMapping::mirrorY;
+    if (dx<=0 || dy<=0) {
+      return TextError::err("LED mapping module #%d has invalid size %dx%d", i, dx, dy);
+    }
+    aMapping->addModule(x, y, dx, dy, flags);
+  }
+  return ErrorPtr();
+}
+
 
 #define MIN_SCROLL_STEP_INTERVAL (20*MilliSecond)
+#define MIN_SCROLL_FRAME_INTERVAL (5*MilliSecond)
 
-#define FOR_EACH_PANEL(m) for(int i=0; i<usedPanels; ++i) { panels[i]->m; }
+#define FOR_EACH_PANEL(m) for(int i=0; i<numPanels(); ++i) { panels[i]->m; }
 
 
 ErrorPtr DispMatrix::processRequest(ApiRequestPtr aRequest)
 {
+  // Note: requests are decoded here, but all changes to the panels are done via execute(),
+  //   because panels might be owned by the render thread.
   JsonObjectPtr data = aRequest->getRequest();
   JsonObjectPtr o = data->get("cmd");
   if (o) {
     // decode commands
     string cmd = o->stringValue();
     if (cmd=="stopscroll") {
-      FOR_EACH_PANEL(dispView->stopScroll());
-      return Error::ok();
+      return execute(boost::bind(&DispMatrix::stopScroll, this));
     }
     else if (cmd=="startscroll") {
       double stepx = 0.25;
       double stepy = 0;
+      double speedx = 0;
+      double speedy = 0;
+      bool timed = false; // stepped by default
       long steps = -1; // forever
       bool roundoffsets = true;
       MLMicroSeconds interval = 20*MilliSecond;
       MLMicroSeconds start = Never; // right away
+      // Note: speedx/speedy (pixels/second) select time parametric scrolling, interval is the frame interval then
+      if (data->get("speedx", o, true)) {
+        speedx = o->doubleValue();
+        timed = true;
+      }
+      if (data->get("speedy", o, true)) {
+        speedy = o->doubleValue();
+        timed = true;
+      }
       if (data->get("stepx", o, true)) {
         stepx = o->doubleValue();
       }
@@ -293,9 +561,16 @@ ErrorPtr DispMatrix::processRequest(ApiRequestPtr aRequest)
         }
         start = MainLoop::unixTimeToMainLoopTime(st);
       }
+      if (timed) {
+        if (interval<MIN_SCROLL_FRAME_INTERVAL) interval = MIN_SCROLL_FRAME_INTERVAL;
+        MLMicroSeconds duration = Infinite;
+        if (data->get("duration", o, true)) {
+          duration = o->doubleValue()*MilliSecond;
+        }
+        return execute(boost::bind(&DispMatrix::startTimedScroll, this, speedx, speedy, interval, duration, start));
+      }
       if (interval<MIN_SCROLL_STEP_INTERVAL) interval = MIN_SCROLL_STEP_INTERVAL;
-      FOR_EACH_PANEL(dispView->startScroll(stepx, stepy, interval, roundoffsets, steps, start));
-      return Error::ok();
+      return execute(boost::bind(&DispMatrix::startScroll, this, stepx, stepy, interval, roundoffsets, steps, start));
     }
     else if (cmd=="fade") {
       int to = 255;
@@ -306,90 +581,444 @@ ErrorPtr DispMatrix::processRequest(ApiRequestPtr aRequest)
       if (data->get("t", o, true)) {
         t = o->doubleValue()*MilliSecond;
       }
-      FOR_EACH_PANEL(dispView->fadeTo(to, t));
-      return Error::ok();
+      return execute(boost::bind(&DispMatrix::fadeTo, this, to, t));
     }
     return inherited::processRequest(aRequest);
   }
   else {
     // decode properties
-    if (data->get("text", o, true)) {
-      string msg = o->stringValue();
-      FOR_EACH_PANEL(setText(msg));
+    // Note: all properties of a request are applied by a single command, so a request is either
+    //   applied entirely or not at all
+    DisplayProperties props;
+    props.hasText = data->get("text", o, true);
+    if (props.hasText) props.text = o->stringValue();
+    props.hasTextColor = data->get("color", o, true);
+    if (props.hasTextColor) props.textColor = webColorToPixel(o->stringValue());
+    props.hasBackgroundColor = data->get("backgroundcolor", o, true);
+    if (props.hasBackgroundColor) props.backgroundColor = webColorToPixel(o->stringValue());
+    props.hasTextSpacing = data->get("spacing", o, true);
+    if (props.hasTextSpacing) props.textSpacing = o->int32Value();
+    props.hasOffsetX = data->get("offsetx", o, true);
+    if (props.hasOffsetX) props.offsetX = o->doubleValue();
+    props.hasOffsetY = data->get("offsety", o, true);
+    if (props.hasOffsetY) props.offsetY = o->doubleValue();
+    props.hasBrightness = data->get("brightness", o, true);
+    if (props.hasBrightness) props.brightness = o->doubleValue()*255;
+    if (
+      !props.hasText && !props.hasTextColor && !props.hasBackgroundColor && !props.hasTextSpacing &&
+      !props.hasOffsetX && !props.hasOffsetY && !props.hasBrightness
+    ) {
+      return Error::ok(); // nothing to change
     }
-    if (data->get("color", o, true)) {
-      PixelColor p = webColorToPixel(o->stringValue());
-      FOR_EACH_PANEL(message->setTextColor(p));
-    }
-    if (data->get("backgroundcolor", o, true)) {
-      PixelColor p = webColorToPixel(o->stringValue());
-      FOR_EACH_PANEL(message->setBackGroundColor(p));
-    }
-    if (data->get("spacing", o, true)) {
-      int spacing = o->int32Value();
-      FOR_EACH_PANEL(message->setTextSpacing(spacing));
-    }
-    if (data->get("offsetx", o, true)) {
-      double offs = o->doubleValue();
-      FOR_EACH_PANEL(setOffsetX(offs));
+    return execute(boost::bind(&DispMatrix::setProperties, this, props));
+  }
+}
+
+
+ErrorPtr DispMatrix::execute(SimpleCB aCommand)
+{
+  if (renderThreadRunning) {
+    // panels are owned by the render thread, pass command
+    if (!commandQueue->push(aCommand)) {
+      return LethdApiError::err("display busy, too many pending commands");
     }
-    if (data->get("offsety", o, true)) {
-      double offs = o->doubleValue();
-      FOR_EACH_PANEL(dispView->setOffsetY(offs));
+  }
+  else {
+    // panels are owned by this thread, execute right now
+    aCommand();
+  }
+  return Error::ok();
+}
+
+
+// MARK: ==== dispmatrix commands
+
+void DispMatrix::setProperties(const DisplayProperties aProps)
+{
+  if (aProps.hasText) setText(aProps.text);
+  if (aProps.hasTextColor) setTextColor(aProps.textColor);
+  if (aProps.hasBackgroundColor) setBackgroundColor(aProps.backgroundColor);
+  if (aProps.hasTextSpacing) setTextSpacing(aProps.textSpacing);
+  if (aProps.hasOffsetX) setOffsetX(aProps.offsetX);
+  if (aProps.hasOffsetY) setOffsetY(aProps.offsetY);
+  if (aProps.hasBrightness) setBrightness(aProps.brightness);
+}
+
+
+void DispMatrix::setText(const string aText)
+{
+  message->setText(aText);
+}
+
+
+void DispMatrix::setTextColor(PixelColor aColor)
+{
+  message->setTextColor(aColor);
+}
+
+
+void DispMatrix::setBackgroundColor(PixelColor aColor)
+{
+  message->setBackGroundColor(aColor);
+}
+
+
+void DispMatrix::setTextSpacing(int aSpacing)
+{
+  message->setTextSpacing(aSpacing);
+}
+
+
+void DispMatrix::setOffsetX(double aOffsetX)
+{
+  scroller->setOffsetX(aOffsetX);
+}
+
+
+void DispMatrix::setOffsetY(double aOffsetY)
+{
+  scroller->setOffsetY(aOffsetY);
+}
+
+
+void DispMatrix::stopScroll()
+{
+  scroller->stopScroll();
+}
+
+
+void DispMatrix::startScroll(double aStepX, double aStepY, MLMicroSeconds aInterval, bool aRoundOffsets, long aNumSteps, MLMicroSeconds aStartTime)
+{
+  scroller->startScroll(aStepX, aStepY, aInterval, aRoundOffsets, aNumSteps, aStartTime);
+}
+
+
+void DispMatrix::startTimedScroll(double aSpeedX, double aSpeedY, MLMicroSeconds aFrameInterval, MLMicroSeconds aDuration, MLMicroSeconds aStartTime)
+{
+  scroller->startTimedScroll(aSpeedX, aSpeedY, aFrameInterval, aDuration, aStartTime);
+}
+
+
+void DispMatrix::fadeTo(int aBrightness, MLMicroSeconds aWithIn)
+{
+  aBrightness = max(0, min(255, aBrightness));
+  if (aWithIn<=0 || aBrightness==brightness) {
+    setBrightness(aBrightness);
+    return;
+  }
+  targetBrightness = aBrightness;
+  fadeDist = targetBrightness-brightness;
+  fadeStartTime = MainLoop::now();
+  fadeTime = aWithIn;
+}
+
+
+void DispMatrix::setBrightness(int aBrightness)
+{
+  targetBrightness = -1; // stop fading
+  brightness = max(0, min(255, aBrightness));
+  FOR_EACH_PANEL(setBrightness(brightness));
+}
+
+
+MLMicroSeconds DispMatrix::stepBrightness()
+{
+  if (targetBrightness<0) return Infinite; // not fading
+  MLMicroSeconds now = MainLoop::now();
+  double timeDone = (double)(now-fadeStartTime)/fadeTime;
+  if (timeDone<1) {
+    // continue fading
+    brightness = targetBrightness-(1-timeDone)*fadeDist;
+    FOR_EACH_PANEL(setBrightness(brightness));
+    // return recommended call-again-time for smooth fading
+    return now+fadeTime/abs(fadeDist); // single brightness steps
+  }
+  // target brightness reached
+  setBrightness(targetBrightness);
+  return Infinite;
+}
+
+
+// MARK: ==== dispmatrix status
+
+void DispMatrix::getDisplayStatus(DisplayStatus &aStatus)
+{
+  aStatus.hasMessage = false;
+  aStatus.hasDispView = false;
+  if (numPanels()>0) {
+    aStatus.hasMessage = true;
+    aStatus.text = message->getText();
+    aStatus.textColor = message->getTextColor();
+    aStatus.textSpacing = message->getTextSpacing();
+    aStatus.backgroundColor = message->getBackGroundColor();
+    DispPanelPtr p = panels[0];
+    if (p->dispView) {
+      aStatus.hasDispView = true;
+      aStatus.brightness = brightness;
+      aStatus.estimatedCurrent = estimatedCurrent;
+      aStatus.powerLimit = powerLimit;
+      aStatus.offsetX = scroller->getOffsetX();
+      aStatus.offsetY = scroller->getOffsetY();
+      aStatus.stepX = scroller->getStepX();
+      aStatus.stepY = scroller->getStepY();
+      aStatus.stepInterval = scroller->getScrollStepInterval();
     }
-    return Error::ok();
   }
 }
 
 
+void DispMatrix::publishStatus()
+{
+  // called from render thread
+  DisplayStatus st;
+  getDisplayStatus(st);
+  pthread_mutex_lock(&statusMutex);
+  publishedStatus = st;
+  pthread_mutex_unlock(&statusMutex);
+}
+
+
 JsonObjectPtr DispMatrix::status()
 {
   JsonObjectPtr answer = inherited::status();
   if (answer->isType(json_type_object)) {
-    if (usedPanels>0) {
-      DispPanelPtr p = panels[0];
-      if (p->message) {
-        answer->add("text", JsonObject::newString(p->message->getText()));
-        answer->add("color", JsonObject::newString(pixelToWebColor(p->message->getTextColor())));
-        answer->add("spacing", JsonObject::newInt32(p->message->getTextSpacing()));
-        answer->add("backgroundcolor", JsonObject::newString(pixelToWebColor(p->message->getBackGroundColor())));
-      }
-      if (p->dispView) {
-        answer->add("brightness", JsonObject::newDouble((double)p->dispView->getAlpha()/255));
-        answer->add("scrolloffsetx", JsonObject::newDouble(p->dispView->getOffsetX()));
-        answer->add("scrolloffsety", JsonObject::newDouble(p->dispView->getOffsetY()));
-        answer->add("scrollstepx", JsonObject::newDouble(p->dispView->getStepX()));
-        answer->add("scrollstepy", JsonObject::newDouble(p->dispView->getStepY()));
-        answer->add("scrollsteptime", JsonObject::newDouble(p->dispView->getScrollStepInterval()/MilliSecond));
-        answer->add("unixtime", JsonObject::newInt64(MainLoop::unixtime()/MilliSecond));
+    DisplayStatus st;
+    if (renderThreadRunning) {
+      // panels are owned by the render thread, use latest published status
+      pthread_mutex_lock(&statusMutex);
+      st = publishedStatus;
+      pthread_mutex_unlock(&statusMutex);
+    }
+    else {
+      getDisplayStatus(st);
+    }
+    if (st.hasMessage) {
+      answer->add("text", JsonObject::newString(st.text));
+      answer->add("color", JsonObject::newString(pixelToWebColor(st.textColor)));
+      answer->add("spacing", JsonObject::newInt32(st.textSpacing));
+      answer->add("backgroundcolor", JsonObject::newString(pixelToWebColor(st.backgroundColor)));
+    }
+    if (st.hasDispView) {
+      answer->add("brightness", JsonObject::newDouble((double)st.brightness/255));
+      answer->add("current", JsonObject::newInt32(st.estimatedCurrent));
+      if (powerBudget>0) {
+        answer->add("powerbudget", JsonObject::newInt32(powerBudget));
+        answer->add("powerlimit", JsonObject::newDouble((double)st.powerLimit/255));
       }
+      answer->add("scrolloffsetx", JsonObject::newDouble(st.offsetX));
+      answer->add("scrolloffsety", JsonObject::newDouble(st.offsetY));
+      answer->add("scrollstepx", JsonObject::newDouble(st.stepX));
+      answer->add("scrollstepy", JsonObject::newDouble(st.stepY));
+      answer->add("scrollsteptime", JsonObject::newDouble(st.stepInterval/MilliSecond));
+      answer->add("unixtime", JsonObject::newInt64(MainLoop::unixtime()/MilliSecond));
     }
+    answer->add("stats", stats(false));
   }
   return answer;
 }
 
 
+JsonObjectPtr DispMatrix::stats(bool aReset)
+{
+  // Note: statistics can be read while render thread is running
+  JsonObjectPtr s = JsonObject::newObj();
+  s->add("lateness", stepLateness.json());
+  s->add("frametime", frameTimes.json());
+  s->add("caughtupsteps", caughtUpSteps.json());
+  JsonObjectPtr p = JsonObject::newArray();
+  for (int i=0; i<numPanels(); ++i) {
+    p->arrayAppend(panels[i]->stats(aReset));
+  }
+  s->add("panels", p);
+  if (aReset) {
+    stepLateness.reset();
+    frameTimes.reset();
+    caughtUpSteps.reset();
+  }
+  return s;
+}
+
+
 // MARK: ==== dispmatrix operation
 
 void DispMatrix::initOperation()
 {
-  stepTicket.executeOnce(boost::bind(&DispMatrix::step, this, _1));
+  if (renderThreads>0 && numPanels()>1 && !renderPool) {
+    // main thread renders too, so one thread less than panels is enough
+    renderPool = WorkerPoolPtr(new WorkerPool(min(renderThreads, numPanels()-1)));
+    LOG(LOG_NOTICE, "- rendering %d panels in parallel using %d worker threads", numPanels(), renderPool->numWorkers());
+  }
+  if (useRenderThread) {
+    startRenderThread();
+  }
+  if (!renderThreadRunning) {
+    stepTicket.executeOnce(boost::bind(&DispMatrix::step, this, _1));
+  }
   setInitialized();
 }
 
 
-void DispMatrix::step(MLTimer &aTimer)
+MLMicroSeconds DispMatrix::renderFrame()
 {
-  MLMicroSeconds nextCall = Infinite;
-  for (int i=0; i<usedPanels; ++i) {
+  MLMicroSeconds start = MainLoop::now();
+  // advance the scroll clock, and position all panels on the content accordingly
+  MLMicroSeconds nextCall;
+  do {
+    nextCall = scroller->step();
+  } while (nextCall==0);
+  long c = scroller->getCaughtUpSteps();
+  caughtUpSteps.add(c-lastCaughtUpSteps);
+  lastCaughtUpSteps = c;
+  // advance brightness fade, affects the output stage only
+  MLMicroSeconds fadeNext = stepBrightness();
+  if (nextCall<0 || (fadeNext>0 && fadeNext<nextCall)) {
+    nextCall = fadeNext;
+  }
+  double offsetX = scroller->getOffsetX();
+  double offsetY = scroller->getOffsetY();
+  for (int i=0; i<numPanels(); ++i) {
+    panels[i]->setScrollOffsets(offsetX, offsetY);
     MLMicroSeconds n = panels[i]->step();
     if (nextCall<0 || (n>0 && n<nextCall)) {
       nextCall = n;
     }
   }
+  // render panels, in parallel if possible
+  if (renderPool) {
+    renderPool->runJobs(numPanels(), boost::bind(&DispMatrix::renderPanel, this, _1));
+  }
+  else {
+    for (int i=0; i<numPanels(); ++i) renderPanel(i);
+  }
+  // shared content is rendered into all panels now
+  for (int i=0; i<numPanels(); ++i) {
+    panels[i]->updated();
+  }
+  scroller->updated();
   MLMicroSeconds now = MainLoop::now();
+  frameTimes.add(now-start);
   if (nextCall<0 || nextCall-now>MAX_STEP_INTERVAL) {
     nextCall = now+MAX_STEP_INTERVAL;
   }
+  nextFrameAt = nextCall;
+  return nextCall;
+}
+
+
+void DispMatrix::renderPanel(int aPanelIndex)
+{
+  panels[aPanelIndex]->render();
+}
+
+
+void DispMatrix::presentFrame()
+{
+  // prepare LED colors, estimating the current needed to show them
+  int idleCurrent = 0;
+  int colorCurrent = 0;
+  for (int i=0; i<numPanels(); ++i) {
+    panels[i]->prepareOutput();
+    idleCurrent += panels[i]->getIdleCurrent();
+    colorCurrent += panels[i]->getUnlimitedColorCurrent();
+  }
+  if (powerBudget>0) {
+    // scale down all panels alike when over budget
+    int available = powerBudget-idleCurrent;
+    int limit = colorCurrent>available ? (available>0 ? available*255/colorCurrent : 0) : 255;
+    if (limit<powerLimit || limit>powerLimit+POWER_LIMIT_HYSTERESIS || (limit==255 && powerLimit!=255)) {
+      if (limit<powerLimit) LOG(LOG_INFO, "estimated LED current %d mA exceeds budget of %d mA -> limiting to %d%%", idleCurrent+colorCurrent, powerBudget, limit*100/255);
+      powerLimit = limit>0 ? limit : 1; // still allows estimating unlimited current
+      for (int i=0; i<numPanels(); ++i) {
+        panels[i]->setPowerLimit(powerLimit);
+        panels[i]->prepareOutput();
+      }
+    }
+  }
+  estimatedCurrent = idleCurrent;
+  for (int i=0; i<numPanels(); ++i) {
+    estimatedCurrent += panels[i]->getColorCurrent();
+    panels[i]->present();
+  }
+}
+
+
+void DispMatrix::recordLateness()
+{
+  if (nextFrameAt!=Never) {
+    stepLateness.add(MainLoop::now()-nextFrameAt);
+  }
+}
+
+
+void DispMatrix::step(MLTimer &aTimer)
+{
+  recordLateness();
+  MLMicroSeconds nextCall = renderFrame();
+  // all rendering is complete, now update LEDs
+  presentFrame();
   MainLoop::currentMainLoop().retriggerTimer(aTimer, nextCall, 0, MainLoop::absolute);
 }
+
+
+// MARK: ==== dispmatrix render thread
+
+void DispMatrix::startRenderThread()
+{
+  if (renderThreadRunning) return;
+  stopRendering = false;
+  publishStatus(); // initial status
+  if (pthread_create(&renderThreadId, NULL, &DispMatrix::renderThreadStart, this)!=0) {
+    LOG(LOG_ERR, "could not start render thread, rendering on main thread");
+    return;
+  }
+  renderThreadRunning = true;
+  LOG(LOG_NOTICE, "- rendering and LED output on separate thread");
+}
+
+
+void DispMatrix::stopRenderThread()
+{
+  if (!renderThreadRunning) return;
+  stopRendering = true;
+  pthread_join(renderThreadId, NULL);
+  renderThreadRunning = false;
+  // panels are owned by this thread again, apply commands possibly still pending
+  commandQueue->executeQueued();
+}
+
+
+void *DispMatrix::renderThreadStart(void *aDispMatrix)
+{
+  static_cast<DispMatrix *>(aDispMatrix)->renderThread();
+  return NULL;
+}
+
+
+void DispMatrix::renderThread()
+{
+  // Note: while this thread runs, it owns the panels (views and LED chains). Other threads
+  //   can only change the panels via commandQueue and read status via publishedStatus.
+  //   Frames are double buffered: the thread renders into the panels' back buffers and
+  //   presents them to the LEDs when the next frame is due, so LED updates happen at
+  //   steady times no matter how long rendering takes.
+  MLMicroSeconds nextFrame = MainLoop::now();
+  bool rendered = false;
+  while (!stopRendering) {
+    // wait until next frame is due
+    MLMicroSeconds now = MainLoop::now();
+    if (nextFrame>now) {
+      usleep((useconds_t)(nextFrame-now));
+    }
+    recordLateness();
+    if (rendered) {
+      // show frame rendered in previous cycle
+      presentFrame();
+    }
+    // apply changes requested by API
+    commandQueue->executeQueued();
+    // step and render next frame
+    nextFrame = renderFrame();
+    rendered = true;
+    publishStatus();
+  }
+}
@@ -22,9 +22,13 @@
 #ifndef __lethd_dispmatrix_hpp__
 #define __lethd_dispmatrix_hpp__
 
-#include "ledchaincomm.hpp"
-
 #include "feature.hpp"
+#include "ledoutput.hpp"
+#include "ledmapping.hpp"
+#include "ledcalibration.hpp"
+#include "workerpool.hpp"
+#include "commandqueue.hpp"
+#include "framestats.hpp"
 #include "viewscroller.hpp"
 #include "textview.hpp"
 
@@ -36,32 +40,111 @@ namespace p44 {
   {
     friend class DispMatrix;
 
-    LEDChainCommPtr chain; ///< the led chain for this panel
+    LEDOutputPtr output; ///< the led chain (or other output) for this panel
+    LEDMappingPtr mapping; ///< maps the LEDs of the chain to the pixels of the back buffer
     int offsetX; ///< X offset within entire display
+    int offsetY; ///< Y offset within entire display
     int cols; ///< total number of columns (including hidden LEDs)
     int rows; ///< number of rows
     int borderRight; ///< number of hidden LEDs at far end
     int borderLeft; ///< number of hidden LEDs at near (connector) end
     int orientation; ///< orientation of content
 
-    ViewScrollerPtr dispView;
-    TextViewPtr message;
+    ViewScrollerPtr dispView; ///< shows the content shared by all panels at this panel's offset
 
     MLMicroSeconds lastUpdate;
+    MLMicroSeconds refreshInterval; ///< interval for showing unchanged frames again to clean away glitches, Never=no refresh
+    std::vector<PremultPixelColor> frame; ///< back buffer: rendered visible pixels (row by row), not yet sent to the chain
+    PixelRect frameDirty; ///< area of the back buffer not yet sent to the chain
+    std::vector<uint32_t> rowHashes; ///< CRC32 of the colors of each row as last sent to the chain
+    std::vector<uint8_t> ledColors; ///< RGB bytes of all LEDs in chain order, before calibration
+    LEDCalibration calibration; ///< gamma, white balance and brightness of this panel's LEDs
+    bool calibrationChanged; ///< set when calibration has changed since the LEDs were last updated
+    std::vector<uint8_t> calibratedColors; ///< RGB bytes of all LEDs in chain order, as passed to the output
+    bool outputPending; ///< calibratedColors have changed, but are not yet passed to the output
+    int colorCurrent; ///< estimated current in mA needed for showing calibratedColors (not including idle current)
+
+    // statistics
+    RollingHistogram renderTimes; ///< time needed to render changes into the back buffer
+    RollingHistogram showTimes; ///< time needed to transfer back buffer to chain and show it
+    std::atomic<long> skippedFrames; ///< rendered frames not shown because they did not differ from the frame already on the chain (counted by renderer, read by main thread)
 
   public:
 
-    DispPanel(const string aChainName, int aOffsetX, int aRows, int aCols, int aBorderLeft, int aBorderRight, int aOrientation);
+    /// @param aOutputSpec LED chain device name or other output specification, see LEDOutput::newOutput()
+    /// @param aOffsetX,aOffsetY position of this panel (tile) on the display canvas
+    /// @param aContent the content view, shared by all panels
+    /// @param aRefreshInterval interval for showing the frame again even if unchanged, to clean away
+    ///   possible glitches on the chain. Never to only show changed frames.
+    /// @param aMapping mapping of the chain's LEDs to the visible aCols-aBorderLeft-aBorderRight x aRows pixels.
+    ///   If NULL, the standard module layout is used: serpentine rows of aCols LEDs each, with aBorderRight
+    ///   hidden LEDs at the start and aBorderLeft hidden LEDs at the end of the first row.
+    DispPanel(const string aOutputSpec, int aOffsetX, int aOffsetY, int aRows, int aCols, int aBorderLeft, int aBorderRight, int aOrientation, ViewPtr aContent, MLMicroSeconds aRefreshInterval, LEDMappingPtr aMapping);
     virtual ~DispPanel();
 
+    /// advance the views' state (scrolling, fading etc.)
+    /// @return time when step() should be called again latest
+    /// @note must be called from the thread that owns the panels
     MLMicroSeconds step();
 
+    /// render changes of the views into the back buffer
+    /// @note only reads the content shared with other panels, and does not access the mainloop, so
+    ///   different panels can be rendered in parallel from different threads
+    void render();
+
+    /// mark the views as updated
+    /// @note must be called after all panels sharing the content are rendered, from the thread that steps the panel
+    void updated();
+
+    /// prepare the LED colors from the rendered frame (mapping and calibration), if the rendered
+    /// frame differs from the one on the LEDs, or calibration has changed
+    /// @note must be called from the thread that steps the panel, can be called again after changing
+    ///   the power limit
+    void prepareOutput();
+
+    /// send the prepared LED colors to the LED output and update the LEDs, if these have changed, or if the
+    /// last update is long enough ago to clean away possible glitches
+    /// @note must be called from the thread that steps the panel
+    void present();
+
+    /// @return estimated current in mA for showing the prepared LED colors, not including idle current
+    int getColorCurrent() { return colorCurrent; }
+
+    /// @return estimated current in mA for showing the prepared LED colors without power limit
+    int getUnlimitedColorCurrent();
+
+    /// @return estimated current in mA the LEDs need when all are off
+    int getIdleCurrent();
+
+    /// limit power by scaling all LED colors
+    /// @param aPowerLimit 0..255
+    void setPowerLimit(uint8_t aPowerLimit);
+
+    /// @param aReset if set, statistics are reset after reporting them
+    /// @return timing statistics of this panel
+    JsonObjectPtr stats(bool aReset);
+
 
   private:
 
-    void setOffsetX(double aOffsetX);
-    void setText(const string aText);
-    void updateDisplay();
+    /// @param aY row in the back buffer
+    /// @return CRC32 of the colors of the row
+    uint32_t rowHash(int aY);
+
+    /// set brightness of the LEDs
+    /// @param aBrightness 0..255
+    /// @note is applied in the output stage, so views need not be rendered again
+    void setBrightness(uint8_t aBrightness);
+
+    /// set gamma and white balance of the LEDs
+    /// @param aGamma gamma exponent, 1 for linear output
+    /// @param aRed,aGreen,aBlue white balance scaling factors 0..1 for the color channels
+    /// @note is applied in the output stage, all LEDs are updated with the next frame
+    void setColorCorrection(double aGamma, double aRed, double aGreen, double aBlue);
+
+    /// position this panel's view on the shared content
+    /// @param aOffsetX,aOffsetY scroll offsets of the entire display, this panel's offsetX/offsetY are added
+    void setScrollOffsets(double aOffsetX, double aOffsetY);
 
   };
   typedef boost::intrusive_ptr<DispPanel> DispPanelPtr;
@@ -72,15 +155,89 @@ namespace p44 {
   {
     typedef Feature inherited;
 
-    static const int numChains = 3;
-    string chainNames[numChains];
-    DispPanelPtr panels[numChains];
-    int usedPanels;
+    static const int numDefaultChains = 3;
+    string chainNames[numDefaultChains]; ///< outputs for the first panels, if not specified in the panel's init data
+    typedef std::vector<DispPanelPtr> PanelsVector;
+    PanelsVector panels; ///< the panels, together forming one display
+
+    TextViewPtr message; ///< the content shown by all panels
+    ViewScrollerPtr scroller; ///< scrolls message, the scroll clock for all panels (not rendered itself)
+
+    MLMicroSeconds refreshInterval; ///< interval for refreshing unchanged panels, Never=no refresh
+
+    // power limiting
+    int powerBudget; ///< max current in mA for all panels together, 0=no limit
+    uint8_t powerLimit; ///< current scaling of all panels' LED colors to stay within powerBudget
+    int estimatedCurrent; ///< estimated current in mA for the LEDs of all panels, as last shown
+
+    // brightness, applied in the panels' output stage
+    int brightness; ///< current brightness 0..255
+    int targetBrightness; ///< brightness being faded to, -1 if not fading
+    int fadeDist; ///< brightness change of the current fade
+    MLMicroSeconds fadeStartTime; ///< start of current fade
+    MLMicroSeconds fadeTime; ///< duration of current fade
+
+    int renderThreads; ///< number of worker threads for rendering panels in parallel, 0=render on main thread
+    WorkerPoolPtr renderPool;
 
     MLTicket stepTicket;
+    MLMicroSeconds nextFrameAt; ///< time when next frame is due
+
+    // statistics
+    RollingHistogram stepLateness; ///< how late frames were started compared to when they were due
+    RollingHistogram frameTimes; ///< time needed to step and render all panels
+    RollingHistogram caughtUpSteps; ///< number of scroll steps that had to be caught up per frame
+    long lastCaughtUpSteps; ///< scroller's caught-up steps counter at last frame
+
+    // dedicated render thread
+    bool useRenderThread; ///< if set, panels are stepped, rendered and shown in a separate thread
+    bool renderThreadRunning; ///< set while render thread exists (only accessed from main thread)
+    std::atomic<bool> stopRendering; ///< set to request render thread to terminate
+    pthread_t renderThreadId;
+    CommandQueuePtr commandQueue; ///< commands from API to the render thread
+
+    /// status of the display, as published by the renderer
+    typedef struct {
+      bool hasMessage;
+      string text;
+      PixelColor textColor;
+      int textSpacing;
+      PixelColor backgroundColor;
+      bool hasDispView;
+      int brightness;
+      int estimatedCurrent;
+      uint8_t powerLimit;
+      double offsetX;
+      double offsetY;
+      double stepX;
+      double stepY;
+      MLMicroSeconds stepInterval;
+    } DisplayStatus;
+    pthread_mutex_t statusMutex; ///< protects publishedStatus
+    DisplayStatus publishedStatus; ///< latest status published by render thread
+
+    /// display properties to be set together, as decoded from one API request
+    typedef struct {
+      bool hasText;
+      string text;
+      bool hasTextColor;
+      PixelColor textColor;
+      bool hasBackgroundColor;
+      PixelColor backgroundColor;
+      bool hasTextSpacing;
+      int textSpacing;
+      bool hasOffsetX;
+      double offsetX;
+      bool hasOffsetY;
+      double offsetY;
+      bool hasBrightness;
+      int brightness;
+    } DisplayProperties;
 
   public:
 
+    /// @param aChainName1,aChainName2,aChainName3 outputs for the first three panels, used when the panel's
+    ///   init data does not specify an "output". Any number of panels can be configured that way.
     DispMatrix(const string aChainName1, const string aChainName2, const string aChainName3);
     virtual ~DispMatrix();
 
@@ -101,11 +258,73 @@ namespace p44 {
     /// @return status information object for initialized feature, bool false for uninitialized
     virtual JsonObjectPtr status() override;
 
+    /// get performance statistics
+    /// @param aReset if set, statistics are reset after reporting them
+    /// @return frame timing statistics
+    virtual JsonObjectPtr stats(bool aReset) override;
+
   private:
 
+    /// @return number of panels
+    int numPanels() { return (int)panels.size(); }
+
     void step(MLTimer &aTimer);
+    void renderPanel(int aPanelIndex);
+
+    /// advance brightness fading
+    /// @return time when to call again, Infinite if not fading
+    MLMicroSeconds stepBrightness();
     void initOperation();
 
+    /// create the content shared by all panels (message and scroller) with default settings
+    void createContent();
+
+    /// append modules and gaps from configuration to a LED mapping
+    /// @param aMapping the mapping to add to
+    /// @param aConfig array of objects, each describing a module or a gap:
+    ///   - { "gap":n }
+    ///   - { "x":x, "y":y, "dx":dx, "dy":dy, "columns":bool, "serpentine":bool, "mirrorx":bool, "mirrory":bool }
+    ///     (x,y default to 0, dx,dy to the canvas size, flags to false)
+    /// @param aCanvasDx,aCanvasDy size of the mapping's canvas
+    /// @return error if configuration is invalid
+    static ErrorPtr addMappingFromConfig(LEDMappingPtr aMapping, JsonObjectPtr aConfig, int aCanvasDx, int aCanvasDy);
+
+    /// step all panels and render them into their back buffers
+    /// @return time when next frame needs to be rendered
+    MLMicroSeconds renderFrame();
+
+    /// record how late the current frame is compared to when it was due
+    void recordLateness();
+
+    /// send rendered frames of all panels to their LEDs
+    void presentFrame();
+
+    void startRenderThread();
+    void stopRenderThread();
+    static void *renderThreadStart(void *aDispMatrix);
+    void renderThread();
+    void getDisplayStatus(DisplayStatus &aStatus);
+    void publishStatus();
+
+    /// execute a command changing the display on the thread that owns the panels
+    /// @param aCommand the command
+    /// @return error if command could not be queued
+    ErrorPtr execute(SimpleCB aCommand);
+
+    // commands, always executed on the thread that owns the panels
+    void setProperties(const DisplayProperties aProps);
+    void setText(const string aText);
+    void setTextColor(PixelColor aColor);
+    void setBackgroundColor(PixelColor aColor);
+    void setTextSpacing(int aSpacing);
+    void setOffsetX(double aOffsetX);
+    void setOffsetY(double aOffsetY);
+    void stopScroll();
+    void startScroll(double aStepX, double aStepY, MLMicroSeconds aInterval, bool aRoundOffsets, long aNumSteps, MLMicroSeconds aStartTime);
+    void startTimedScroll(double aSpeedX, double aSpeedY, MLMicroSeconds aFrameInterval, MLMicroSeconds aDuration, MLMicroSeconds aStartTime);
+    void fadeTo(int aBrightness, MLMicroSeconds aWithIn);
+    void setBrightness(int aBrightness);
+
 
   };
 
@@ -60,6 +60,12 @@ JsonObjectPtr Feature::status()
 }
 
 
+JsonObjectPtr Feature::stats(bool aReset)
+{
+  return JsonObjectPtr(); // no statistics by default
+}
+
+
 
 void Feature::reset()
 {
@@ -61,6 +61,11 @@ namespace p44 {
     /// @return status information object for initialized feature, bool false for uninitialized
     virtual JsonObjectPtr status();
 
+    /// get performance statistics
+    /// @param aReset if set, statistics are reset after reporting them
+    /// @return statistics object, NULL if feature has no statistics
+    virtual JsonObjectPtr stats(bool aReset);
+
   protected:
 
     void setInitialized() { initialized = true; }
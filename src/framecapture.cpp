@@ -0,0 +1,253 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "framecapture.hpp"
+
+using namespace p44;
+
+
+#define CAPTURE_MAGIC "LETHDCAP"
+#define CAPTURE_MAGIC_LEN 8
+#define CAPTURE_VERSION 1
+
+#define CAPTURE_CHANNEL_RECORD 'C'
+#define CAPTURE_FRAME_RECORD 'F'
+
+#define CAPTURE_FLAG_XREVERSED 0x01
+#define CAPTURE_FLAG_ALTERNATING 0x02
+
+
+static void appendUInt(std::vector<uint8_t> &aBuf, uint64_t aValue, int aBytes)
+{
+  for (int i=0; i<aBytes; i++) {
+    aBuf.push_back(aValue & 0xFF);
+    aValue >>= 8;
+  }
+}
+
+
+static bool readUInt(FILE *aFile, uint64_t &aValue, int aBytes)
+{
+  uint8_t buf[8];
+  if (fread(buf, 1, aBytes, aFile)!=(size_t)aBytes) return false;
+  aValue = 0;
+  for (int i=aBytes-1; i>=0; i--) {
+    aValue = (aValue<<8) | buf[i];
+  }
+  return true;
+}
+
+
+// MARK: ===== FrameCapture
+
+FrameCapturePtr FrameCapture::sharedCapture;
+
+
+FrameCapture::FrameCapture() :
+  file(NULL),
+  startTime(Never)
+{
+  pthread_mutex_init(&mutex, NULL);
+}
+
+
+FrameCapture::~FrameCapture()
+{
+  close();
+  pthread_mutex_destroy(&mutex);
+}
+
+
+ErrorPtr FrameCapture::startCapture(const string aPath)
+{
+  FrameCapturePtr capture = FrameCapturePtr(new FrameCapture);
+  ErrorPtr err = capture->open(aPath);
+  if (Error::isOK(err)) {
+    sharedCapture = capture;
+  }
+  return err;
+}
+
+
+ErrorPtr FrameCapture::open(const string aPath)
+{
+  close();
+  file = fopen(aPath.c_str(), "wb");
+  if (!file) {
+    return TextError::err("cannot create capture file %s: %s", aPath.c_str(), strerror(errno));
+  }
+  std::vector<uint8_t> hdr(CAPTURE_MAGIC, CAPTURE_MAGIC+CAPTURE_MAGIC_LEN);
+  appendUInt(hdr, CAPTURE_VERSION, 2);
+  fwrite(&hdr[0], 1, hdr.size(), file);
+  channels.clear();
+  startTime = MainLoop::now();
+  LOG(LOG_NOTICE, "Capturing LED output frames to %s", aPath.c_str());
+  return ErrorPtr();
+}
+
+
+void FrameCapture::close()
+{
+  pthread_mutex_lock(&mutex);
+  if (file) {
+    fclose(file);
+    file = NULL;
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+
+int FrameCapture::addChannel(const CaptureChannel &aChannel)
+{
+  int ch = -1;
+  pthread_mutex_lock(&mutex);
+  if (file) {
+    // outputs re-created for the same chain (e.g. on re-initializing panels) share their channel
+    for (int i=0; i<(int)channels.size(); i++) {
+      const CaptureChannel &c = channels[i];
+      if (
+        c.outputSpec==aChannel.outputSpec && c.numLeds==aChannel.numLeds && c.ledsPerRow==aChannel.ledsPerRow &&
+        c.xReversed==aChannel.xReversed && c.alternating==aChannel.alternating
+      ) {
+        ch = i;
+        break;
+      }
+    }
+    if (ch<0) {
+      if (channels.size()>=256) {
+        LOG(LOG_ERR, "Capture channel limit reached, frames sent to '%s' are not recorded", aChannel.outputSpec.c_str());
+      }
+      else {
+        ch = (int)channels.size();
+        channels.push_back(aChannel);
+        std::vector<uint8_t> rec;
+        rec.push_back(CAPTURE_CHANNEL_RECORD);
+        appendUInt(rec, ch, 1);
+        appendUInt(rec, aChannel.numLeds, 2);
+        appendUInt(rec, aChannel.ledsPerRow, 2);
+        appendUInt(rec, (aChannel.xReversed ? CAPTURE_FLAG_XREVERSED : 0) | (aChannel.alternating ? CAPTURE_FLAG_ALTERNATING : 0), 1);
+        appendUInt(rec, aChannel.outputSpec.size(), 2);
+        rec.insert(rec.end(), aChannel.outputSpec.begin(), aChannel.outputSpec.end());
+        fwrite(&rec[0], 1, rec.size(), file);
+      }
+    }
+  }
+  pthread_mutex_unlock(&mutex);
+  return ch;
+}
+
+
+void FrameCapture::recordFrame(int aChannel, const uint8_t *aPixels, uint16_t aNumLeds)
+{
+  if (aChannel<0) return;
+  std::vector<uint8_t> hdr;
+  hdr.push_back(CAPTURE_FRAME_RECORD);
+  appendUInt(hdr, aChannel, 1);
+  appendUInt(hdr, MainLoop::now()-startTime, 8);
+  appendUInt(hdr, aNumLeds, 2);
+  pthread_mutex_lock(&mutex);
+  if (file) {
+    fwrite(&hdr[0], 1, hdr.size(), file);
+    fwrite(aPixels, 3, aNumLeds, file);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+
+// MARK: ===== FrameCaptureReader
+
+FrameCaptureReader::FrameCaptureReader() :
+  file(NULL)
+{
+}
+
+
+FrameCaptureReader::~FrameCaptureReader()
+{
+  if (file) fclose(file);
+}
+
+
+ErrorPtr FrameCaptureReader::open(const string aPath)
+{
+  if (file) fclose(file);
+  channels.clear();
+  file = fopen(aPath.c_str(), "rb");
+  if (!file) {
+    return TextError::err("cannot open capture file %s: %s", aPath.c_str(), strerror(errno));
+  }
+  char magic[CAPTURE_MAGIC_LEN];
+  uint64_t version;
+  if (
+    fread(magic, 1, CAPTURE_MAGIC_LEN, file)!=CAPTURE_MAGIC_LEN ||
+    memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN)!=0 ||
+    !readUInt(file, version, 2)
+  ) {
+    return TextError::err("%s is not a frame capture file", aPath.c_str());
+  }
+  if (version!=CAPTURE_VERSION) {
+    return TextError::err("%s has unsupported capture file version %d", aPath.c_str(), (int)version);
+  }
+  return ErrorPtr();
+}
+
+
+bool FrameCaptureReader::readFrame(CapturedFrame &aFrame, ErrorPtr &aError)
+{
+  if (!file) return false;
+  int type;
+  while ((type = fgetc(file))!=EOF) {
+    uint64_t ch, numLeds, v;
+    if (!readUInt(file, ch, 1)) break;
+    if (type==CAPTURE_CHANNEL_RECORD) {
+      CaptureChannel c;
+      if (ch!=channels.size()) break;
+      if (!readUInt(file, numLeds, 2)) break;
+      c.numLeds = numLeds;
+      if (!readUInt(file, v, 2)) break;
+      c.ledsPerRow = v;
+      if (!readUInt(file, v, 1)) break;
+      c.xReversed = v & CAPTURE_FLAG_XREVERSED;
+      c.alternating = v & CAPTURE_FLAG_ALTERNATING;
+      if (!readUInt(file, v, 2)) break;
+      c.outputSpec.resize(v);
+      if (v>0 && fread(&c.outputSpec[0], 1, v, file)!=v) break;
+      channels.push_back(c);
+    }
+    else if (type==CAPTURE_FRAME_RECORD) {
+      if (ch>=channels.size()) break;
+      aFrame.channel = (int)ch;
+      if (!readUInt(file, v, 8)) break;
+      aFrame.time = v;
+      if (!readUInt(file, numLeds, 2)) break;
+      aFrame.pixels.resize(numLeds*3);
+      if (numLeds>0 && fread(&aFrame.pixels[0], 3, numLeds, file)!=numLeds) break;
+      return true;
+    }
+    else {
+      break;
+    }
+  }
+  if (!feof(file)) {
+    aError = TextError::err("corrupt frame capture file");
+  }
+  return false;
+}
@@ -0,0 +1,138 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __lethd_framecapture_hpp__
+#define __lethd_framecapture_hpp__
+
+#include "p44utils_common.hpp"
+
+#include <pthread.h>
+
+// Capture file format (all numbers little endian):
+// - header: "LETHDCAP", uint16 version
+// - channel record: 'C', uint8 channel, uint16 numLeds, uint16 ledsPerRow, uint8 flags (bit0=xReversed, bit1=alternating),
+//   uint16 length of output spec, output spec
+// - frame record: 'F', uint8 channel, uint64 uS since capture start, uint16 numLeds, numLeds*3 bytes RGB in chain order
+
+namespace p44 {
+
+  /// description of a captured LED chain
+  typedef struct {
+    string outputSpec; ///< the output specification the chain was created with
+    uint16_t numLeds;
+    uint16_t ledsPerRow;
+    bool xReversed;
+    bool alternating;
+  } CaptureChannel;
+
+
+  /// a captured frame
+  typedef struct {
+    int channel; ///< index of the channel (chain) the frame was sent to
+    MLMicroSeconds time; ///< time since start of the capture
+    std::vector<uint8_t> pixels; ///< RGB bytes in chain order
+  } CapturedFrame;
+
+
+  class FrameCapture;
+  typedef boost::intrusive_ptr<FrameCapture> FrameCapturePtr;
+
+  /// Records every frame sent to LED outputs, with timestamps, into a binary file
+  /// @note frames can be recorded from different threads
+  class FrameCapture : public P44Obj
+  {
+    pthread_mutex_t mutex; ///< protects file and channels
+    FILE *file;
+    std::vector<CaptureChannel> channels; ///< channels defined in the capture file so far
+    MLMicroSeconds startTime;
+
+    static FrameCapturePtr sharedCapture;
+
+  public:
+
+    FrameCapture();
+    virtual ~FrameCapture();
+
+    /// start capturing frames of all LED outputs created from now on
+    /// @param aPath capture file to create
+    /// @return error if capture file cannot be created
+    static ErrorPtr startCapture(const string aPath);
+
+    /// @return the capture all LED outputs are recorded to, NULL if not capturing
+    static FrameCapturePtr currentCapture() { return sharedCapture; }
+
+    /// create capture file
+    /// @param aPath capture file to create
+    /// @return error if any
+    ErrorPtr open(const string aPath);
+
+    /// finish capture file
+    void close();
+
+    /// add a channel, or reuse the already defined channel with the same description
+    /// @param aChannel description of the channel
+    /// @return channel index to use for recordFrame(), -1 if not capturing or channel limit reached
+    int addChannel(const CaptureChannel &aChannel);
+
+    /// record a frame
+    /// @param aChannel channel index as returned by addChannel()
+    /// @param aPixels RGB bytes in chain order
+    /// @param aNumLeds number of LEDs
+    void recordFrame(int aChannel, const uint8_t *aPixels, uint16_t aNumLeds);
+
+  };
+
+
+  /// Reads capture files written by FrameCapture
+  class FrameCaptureReader : public P44Obj
+  {
+    FILE *file;
+    std::vector<CaptureChannel> channels;
+
+  public:
+
+    FrameCaptureReader();
+    virtual ~FrameCaptureReader();
+
+    /// open a capture file
+    /// @param aPath capture file
+    /// @return error if file cannot be opened or is not a capture file
+    ErrorPtr open(const string aPath);
+
+    /// read next frame
+    /// @param aFrame will receive the frame
+    /// @param aError will be set to an error if the file is corrupt
+    /// @return false at end of file or on error
+    bool readFrame(CapturedFrame &aFrame, ErrorPtr &aError);
+
+    /// @param aChannel channel index
+    /// @return the channel description (the channel record always precedes the channel's frames)
+    const CaptureChannel &channel(int aChannel) { return channels[aChannel]; }
+
+    /// @return number of channels seen so far
+    int numChannels() { return (int)channels.size(); }
+
+  };
+  typedef boost::intrusive_ptr<FrameCaptureReader> FrameCaptureReaderPtr;
+
+} // namespace p44
+
+#endif /* __lethd_framecapture_hpp__ */
@@ -0,0 +1,156 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "framereplay.hpp"
+
+using namespace p44;
+
+
+#define REPLAY_STATS_WINDOW 1000 // number of most recent frames output time statistics are calculated over
+#define MAX_REPLAY_SLICE (50*MilliSecond) // max time to replay frames at max speed before letting mainloop run
+
+
+// MARK: ===== FrameReplay
+
+FrameReplay::FrameReplay(const string aOutputSpec, bool aMaxSpeed) :
+  outputSpec(aOutputSpec),
+  maxSpeed(aMaxSpeed),
+  startTime(Never),
+  endTime(Never),
+  outputTime(0),
+  frames(0),
+  hasNextFrame(false),
+  showTimes(REPLAY_STATS_WINDOW, RollingHistogram::timeLimits, RollingHistogram::numTimeLimits, MilliSecond)
+{
+}
+
+
+FrameReplay::~FrameReplay()
+{
+  replayTicket.cancel();
+}
+
+
+ErrorPtr FrameReplay::start(const string aCaptureFile, SimpleCB aDoneCB)
+{
+  reader = FrameCaptureReaderPtr(new FrameCaptureReader);
+  ErrorPtr err = reader->open(aCaptureFile);
+  if (!Error::isOK(err)) return err;
+  hasNextFrame = reader->readFrame(nextFrame, err);
+  if (!Error::isOK(err)) return err;
+  doneCB = aDoneCB;
+  frames = 0;
+  outputTime = 0;
+  showTimes.reset();
+  LOG(LOG_NOTICE, "Replaying %s %s", aCaptureFile.c_str(), maxSpeed ? "at max speed" : "at original speed");
+  startTime = MainLoop::now();
+  endTime = Never;
+  replayTicket.executeOnce(boost::bind(&FrameReplay::replayFrames, this, _1));
+  return ErrorPtr();
+}
+
+
+void FrameReplay::replayFrames(MLTimer &aTimer)
+{
+  MLMicroSeconds now = MainLoop::now();
+  MLMicroSeconds sliceEnd = now+MAX_REPLAY_SLICE;
+  while (hasNextFrame) {
+    if (maxSpeed) {
+      if (now>sliceEnd) {
+        // let mainloop run other things, too
+        MainLoop::currentMainLoop().retriggerTimer(aTimer, now, 0, MainLoop::absolute);
+        return;
+      }
+    }
+    else {
+      MLMicroSeconds due = startTime+nextFrame.time;
+      if (due>now) {
+        MainLoop::currentMainLoop().retriggerTimer(aTimer, due, 0, MainLoop::absolute);
+        return;
+      }
+    }
+    outputFrame(nextFrame);
+    ErrorPtr err;
+    hasNextFrame = reader->readFrame(nextFrame, err);
+    if (!Error::isOK(err)) {
+      LOG(LOG_WARNING, "Replay stopped early: %s", err->description().c_str());
+    }
+    now = MainLoop::now();
+  }
+  finish();
+}
+
+
+void FrameReplay::outputFrame(const CapturedFrame &aFrame)
+{
+  while ((int)outputs.size()<=aFrame.channel) {
+    // channel records always precede frames, so channel description is available
+    int ch = (int)outputs.size();
+    const CaptureChannel &c = reader->channel(ch);
+    string spec = c.outputSpec;
+    if (!outputSpec.empty()) {
+      spec = outputSpec;
+      if (reader->numChannels()>1 && spec.substr(0,5)=="file:") {
+        string_format_append(spec, ".%d", ch);
+      }
+    }
+    LEDOutputPtr output = LEDOutput::newOutput(spec, c.numLeds, c.ledsPerRow, c.xReversed, c.alternating);
+    output->begin();
+    outputs.push_back(output);
+  }
+  MLMicroSeconds start = MainLoop::now();
+  LEDOutputPtr output = outputs[aFrame.channel];
+  int n = min((int)output->getNumLeds(), (int)aFrame.pixels.size()/3);
+  if (n>0) output->setColors(0, n, &aFrame.pixels[0]);
+  output->show();
+  MLMicroSeconds t = MainLoop::now()-start;
+  showTimes.add(t);
+  outputTime += t;
+  frames++;
+}
+
+
+void FrameReplay::finish()
+{
+  endTime = MainLoop::now();
+  for (size_t i=0; i<outputs.size(); ++i) {
+    outputs[i]->end();
+  }
+  LOG(LOG_NOTICE, "Replay complete: %s", stats()->c_strValue());
+  if (doneCB) {
+    SimpleCB cb = doneCB;
+    doneCB = NULL;
+    cb();
+  }
+}
+
+
+JsonObjectPtr FrameReplay::stats()
+{
+  JsonObjectPtr s = JsonObject::newObj();
+  MLMicroSeconds duration = startTime==Never ? 0 : (endTime==Never ? MainLoop::now() : endTime)-startTime;
+  s->add("frames", JsonObject::newInt64(frames));
+  s->add("duration", JsonObject::newDouble((double)duration/Second));
+  s->add("framerate", JsonObject::newDouble(duration>0 ? (double)frames*Second/duration : 0));
+  s->add("outputtime", JsonObject::newDouble((double)outputTime/Second));
+  s->add("showtime", showTimes.json());
+  return s;
+}
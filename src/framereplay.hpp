@@ -0,0 +1,81 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __lethd_framereplay_hpp__
+#define __lethd_framereplay_hpp__
+
+#include "p44utils_common.hpp"
+#include "jsonobject.hpp"
+
+#include "framecapture.hpp"
+#include "framestats.hpp"
+#include "ledoutput.hpp"
+
+namespace p44 {
+
+  /// Feeds frames recorded by FrameCapture back through the LED outputs
+  class FrameReplay : public P44Obj
+  {
+    FrameCaptureReaderPtr reader;
+    string outputSpec; ///< if not empty, used instead of the output specs recorded in the capture
+    bool maxSpeed; ///< if set, frames are replayed as fast as possible instead of at original timing
+    std::vector<LEDOutputPtr> outputs; ///< outputs by channel index
+    SimpleCB doneCB;
+    MLTicket replayTicket;
+    MLMicroSeconds startTime;
+    MLMicroSeconds endTime;
+    MLMicroSeconds outputTime; ///< total time spent in the output stage
+    long frames;
+    CapturedFrame nextFrame;
+    bool hasNextFrame;
+    RollingHistogram showTimes; ///< time needed per frame to pass it to the output and show it
+
+  public:
+
+    /// create replay
+    /// @param aOutputSpec if not empty, all channels are replayed to this output instead of the
+    ///   outputs recorded in the capture (e.g. "memory" for measuring the output stage only).
+    ///   With multiple channels, file outputs get the channel index appended to the path.
+    /// @param aMaxSpeed if set, replay as fast as possible, otherwise with original frame timing
+    FrameReplay(const string aOutputSpec, bool aMaxSpeed);
+    virtual ~FrameReplay();
+
+    /// start replaying
+    /// @param aCaptureFile capture file to replay
+    /// @param aDoneCB called when replay is complete
+    /// @return error if capture file cannot be read
+    ErrorPtr start(const string aCaptureFile, SimpleCB aDoneCB);
+
+    /// @return replay statistics: frames, duration, frame rate and output times
+    JsonObjectPtr stats();
+
+  private:
+
+    void replayFrames(MLTimer &aTimer);
+    void outputFrame(const CapturedFrame &aFrame);
+    void finish();
+
+  };
+  typedef boost::intrusive_ptr<FrameReplay> FrameReplayPtr;
+
+} // namespace p44
+
+#endif /* __lethd_framereplay_hpp__ */
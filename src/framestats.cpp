@@ -0,0 +1,114 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "framestats.hpp"
+
+#include <algorithm>
+
+using namespace p44;
+
+
+// MARK: ===== RollingHistogram
+
+const int64_t RollingHistogram::timeLimits[] = {
+  100, 200, 500,
+  1*MilliSecond, 2*MilliSecond, 5*MilliSecond,
+  10*MilliSecond, 20*MilliSecond, 50*MilliSecond,
+  100*MilliSecond
+};
+const int RollingHistogram::numTimeLimits = sizeof(timeLimits)/sizeof(int64_t);
+
+const int64_t RollingHistogram::countLimits[] = { 0, 1, 2, 5, 10 };
+const int RollingHistogram::numCountLimits = sizeof(countLimits)/sizeof(int64_t);
+
+
+RollingHistogram::RollingHistogram(size_t aWindowSize, const int64_t *aBucketLimits, int aNumLimits, double aUnit) :
+  nextSample(0),
+  numSamples(0),
+  totalSamples(0),
+  bucketLimits(aBucketLimits),
+  numLimits(aNumLimits),
+  unit(aUnit)
+{
+  pthread_mutex_init(&mutex, NULL);
+  samples.resize(aWindowSize>0 ? aWindowSize : 1);
+}
+
+
+RollingHistogram::~RollingHistogram()
+{
+  pthread_mutex_destroy(&mutex);
+}
+
+
+void RollingHistogram::add(int64_t aValue)
+{
+  pthread_mutex_lock(&mutex);
+  samples[nextSample] = aValue;
+  nextSample = (nextSample+1) % samples.size();
+  if (numSamples<samples.size()) numSamples++;
+  totalSamples++;
+  pthread_mutex_unlock(&mutex);
+}
+
+
+void RollingHistogram::reset()
+{
+  pthread_mutex_lock(&mutex);
+  nextSample = 0;
+  numSamples = 0;
+  totalSamples = 0;
+  pthread_mutex_unlock(&mutex);
+}
+
+
+JsonObjectPtr RollingHistogram::json()
+{
+  // copy values, so calculation does not block adding new values
+  pthread_mutex_lock(&mutex);
+  std::vector<int64_t> v(samples.begin(), samples.begin()+numSamples);
+  uint64_t total = totalSamples;
+  pthread_mutex_unlock(&mutex);
+  JsonObjectPtr stats = JsonObject::newObj();
+  stats->add("total", JsonObject::newInt64(total));
+  stats->add("count", JsonObject::newInt64(v.size()));
+  if (v.empty()) return stats;
+  std::sort(v.begin(), v.end());
+  int64_t sum = 0;
+  for (size_t i=0; i<v.size(); i++) sum += v[i];
+  stats->add("min", JsonObject::newDouble(v.front()/unit));
+  stats->add("avg", JsonObject::newDouble((double)sum/v.size()/unit));
+  stats->add("max", JsonObject::newDouble(v.back()/unit));
+  stats->add("p50", JsonObject::newDouble(v[(v.size()-1)*50/100]/unit));
+  stats->add("p95", JsonObject::newDouble(v[(v.size()-1)*95/100]/unit));
+  stats->add("p99", JsonObject::newDouble(v[(v.size()-1)*99/100]/unit));
+  // histogram: number of values <= limit (and above previous limit)
+  JsonObjectPtr histogram = JsonObject::newObj();
+  std::vector<int64_t>::iterator pos = v.begin();
+  for (int b=0; b<=numLimits; b++) {
+    std::vector<int64_t>::iterator end = b<numLimits ? std::upper_bound(pos, v.end(), bucketLimits[b]) : v.end();
+    string key = b<numLimits ? string_format("%g", bucketLimits[b]/unit) : "more";
+    histogram->add(key.c_str(), JsonObject::newInt64(end-pos));
+    pos = end;
+  }
+  stats->add("histogram", histogram);
+  return stats;
+}
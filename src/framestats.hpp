@@ -0,0 +1,80 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __lethd_framestats_hpp__
+#define __lethd_framestats_hpp__
+
+#include "p44utils_common.hpp"
+#include "jsonobject.hpp"
+
+#include <pthread.h>
+
+namespace p44 {
+
+  /// Statistics over the most recent values of some measurement (e.g. frame render times)
+  /// @note values can be added from one thread while another thread reads the statistics
+  class RollingHistogram
+  {
+    pthread_mutex_t mutex; ///< protects samples
+    std::vector<int64_t> samples; ///< ring buffer of most recent values
+    size_t nextSample; ///< index in samples where next value will be stored
+    size_t numSamples; ///< number of valid samples
+    uint64_t totalSamples; ///< number of values added since last reset
+    const int64_t *bucketLimits; ///< upper (inclusive) limits of the histogram buckets, last bucket has no limit
+    int numLimits; ///< number of bucket limits
+    double unit; ///< values are reported divided by this
+
+  public:
+
+    /// create histogram
+    /// @param aWindowSize number of most recent values to keep
+    /// @param aBucketLimits array of ascending, inclusive upper limits of the histogram buckets.
+    ///   Values above the last limit are counted in an extra overflow bucket. Must stay valid for
+    ///   the lifetime of the histogram.
+    /// @param aNumLimits number of limits in aBucketLimits
+    /// @param aUnit values are divided by this for reporting (e.g. MilliSecond to report times in mS)
+    RollingHistogram(size_t aWindowSize, const int64_t *aBucketLimits, int aNumLimits, double aUnit);
+    ~RollingHistogram();
+
+    /// add a value
+    /// @param aValue the value
+    void add(int64_t aValue);
+
+    /// forget all values
+    void reset();
+
+    /// @return statistics as JSON object: number of values, min/avg/max, percentiles and histogram,
+    ///   all calculated over the most recent values
+    JsonObjectPtr json();
+
+    /// bucket limits for times (in uS) around the display step interval
+    static const int64_t timeLimits[];
+    static const int numTimeLimits;
+
+    /// bucket limits for small counts (e.g. caught-up steps per frame)
+    static const int64_t countLimits[];
+    static const int numCountLimits;
+
+  };
+
+} // namespace p44
+
+#endif /* __lethd_framestats_hpp__ */
@@ -27,7 +27,8 @@ using namespace p44;
 
 
 ImageView::ImageView() :
-  pngBuffer(NULL)
+  pngBuffer(NULL),
+  opaque(false)
 {
 }
 
@@ -48,6 +49,8 @@ void ImageView::clear()
     free(pngBuffer);
     pngBuffer = NULL;
   }
+  premultipliedImage.clear();
+  opaque = false;
 }
 
 
@@ -71,8 +74,7 @@ ErrorPtr ImageView::loadPNG(const string aPNGFileName)
     LOG(LOG_INFO, "Image width = %d", pngImage.width);
     LOG(LOG_INFO, "Image height = %d", pngImage.height);
     LOG(LOG_INFO, "Image width*height = %d", pngImage.height*pngImage.width);
-    contentSizeX = pngImage.width;
-    contentSizeY = pngImage.height;
+    setContentSize(pngImage.width, pngImage.height);
     if (pngBuffer==NULL) {
       return TextError::err("Could not allocate buffer for reading PNG file %s", aPNGFileName.c_str());
     }
@@ -89,6 +91,22 @@ ErrorPtr ImageView::loadPNG(const string aPNGFileName)
       clear(); // clear only after pngImage.message has been used
       return err;
     }
+    // convert once to premultiplied alpha for compositing
+    premultipliedImage.resize(pngImage.width*pngImage.height);
+    opaque = true;
+    for (int y=0; y<contentSizeY; y++) {
+      PremultPixelColor *pp = &premultipliedImage[y*contentSizeX];
+      uint8_t *pix = pngBuffer+(pngImage.height-1-y)*pngImage.width*4;
+      for (int x=0; x<contentSizeX; x++) {
+        PixelColor p;
+        p.r = *pix++;
+        p.g = *pix++;
+        p.b = *pix++;
+        p.a = *pix++;
+        if (p.a!=255) opaque = false;
+        pp[x] = premultipliedPixel(p);
+      }
+    }
   }
   // image read ok
   makeDirty();
@@ -113,3 +131,42 @@ PixelColor ImageView::contentColorAt(int aX, int aY)
   }
 }
 
+
+void ImageView::contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels)
+{
+  if (aY<0 || aY>=contentSizeY) {
+    inherited::contentRowColorsAt(aX, aY, aNumPixels, aPixels);
+    return;
+  }
+  // image buffer row (content Y goes up, PNG rows are stored top-down)
+  uint8_t *row = pngBuffer+(pngImage.height-1-aY)*pngImage.width*4;
+  for (int i=0; i<aNumPixels; ++i) {
+    int x = aX+i;
+    if (x<0 || x>=contentSizeX) {
+      aPixels[i] = backgroundColor;
+    }
+    else {
+      uint8_t *pix = row+x*4;
+      aPixels[i].r = pix[0];
+      aPixels[i].g = pix[1];
+      aPixels[i].b = pix[2];
+      aPixels[i].a = pix[3];
+    }
+  }
+}
+
+
+void ImageView::contentPremultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels)
+{
+  if (aY<0 || aY>=contentSizeY || premultipliedImage.empty()) {
+    inherited::contentPremultipliedRowColorsAt(aX, aY, aNumPixels, aPixels);
+    return;
+  }
+  const PremultPixelColor *row = &premultipliedImage[aY*contentSizeX];
+  PremultPixelColor bg = premultipliedPixel(backgroundColor);
+  for (int i=0; i<aNumPixels; ++i) {
+    int x = aX+i;
+    aPixels[i] = x<0 || x>=contentSizeX ? bg : row[x];
+  }
+}
+
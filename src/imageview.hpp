@@ -36,6 +36,8 @@ namespace p44 {
 
     png_image pngImage; /// The control structure used by libpng
     png_bytep pngBuffer; /// byte buffer
+    std::vector<PremultPixelColor> premultipliedImage; /// image with premultiplied alpha, rows in content Y order
+    bool opaque; /// set if all image pixels are fully opaque
 
   public :
 
@@ -54,6 +56,15 @@ namespace p44 {
     /// get content color at X,Y
     virtual PixelColor contentColorAt(int aX, int aY) P44_OVERRIDE;
 
+    /// get a horizontal run of content pixel colors
+    virtual void contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels) P44_OVERRIDE;
+
+    /// get a horizontal run of content pixel colors with premultiplied alpha
+    virtual void contentPremultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels) P44_OVERRIDE;
+
+    /// @return true if all image pixels are fully opaque
+    virtual bool contentIsOpaque() P44_OVERRIDE { return opaque; }
+
   };
   typedef boost::intrusive_ptr<ImageView> ImageViewPtr;
 
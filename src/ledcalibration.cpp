@@ -0,0 +1,126 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "ledcalibration.hpp"
+
+#include <math.h>
+
+using namespace p44;
+
+
+// MARK: ===== LEDCalibration
+
+LEDCalibration::LEDCalibration() :
+  gamma(1),
+  brightness(255),
+  powerLimit(255)
+{
+  whiteBalance[0] = 1;
+  whiteBalance[1] = 1;
+  whiteBalance[2] = 1;
+  updateGammaTable();
+}
+
+
+void LEDCalibration::setGamma(double aGamma)
+{
+  if (aGamma<=0) aGamma = 1;
+  gamma = aGamma;
+  updateGammaTable();
+}
+
+
+void LEDCalibration::setWhiteBalance(double aRed, double aGreen, double aBlue)
+{
+  whiteBalance[0] = max(0.0, min(1.0, aRed));
+  whiteBalance[1] = max(0.0, min(1.0, aGreen));
+  whiteBalance[2] = max(0.0, min(1.0, aBlue));
+  updateTables();
+}
+
+
+bool LEDCalibration::setBrightness(uint8_t aBrightness)
+{
+  if (aBrightness==brightness) return false;
+  brightness = aBrightness;
+  updateTables();
+  return true;
+}
+
+
+bool LEDCalibration::setPowerLimit(uint8_t aPowerLimit)
+{
+  if (aPowerLimit==powerLimit) return false;
+  powerLimit = aPowerLimit;
+  updateTables();
+  return true;
+}
+
+
+void LEDCalibration::updateGammaTable()
+{
+  // the expensive part, only needed when gamma changes
+  for (int v=0; v<256; ++v) {
+    gammaTable[v] = pow((double)v/255, gamma);
+  }
+  updateTables();
+}
+
+
+void LEDCalibration::updateTables()
+{
+  identity = true;
+  for (int c=0; c<3; ++c) {
+    double scale = 255*whiteBalance[c]*brightness/255*powerLimit/255;
+    for (int v=0; v<256; ++v) {
+      uint8_t t = (uint8_t)(gammaTable[v]*scale+0.5);
+      tables[c][v] = t;
+      if (t!=v) identity = false;
+    }
+  }
+}
+
+
+uint32_t LEDCalibration::apply(const uint8_t *aRGB, uint8_t *aCalibratedRGB, int aNumLeds) const
+{
+  uint32_t sum = 0;
+  const uint8_t *end = aRGB+3*aNumLeds;
+  if (identity) {
+    if (aCalibratedRGB!=aRGB) memcpy(aCalibratedRGB, aRGB, 3*aNumLeds);
+    while (aRGB<end) sum += *aRGB++;
+    return sum;
+  }
+  const uint8_t *r = tables[0];
+  const uint8_t *g = tables[1];
+  const uint8_t *b = tables[2];
+  while (aRGB<end) {
+    uint8_t cr = r[aRGB[0]];
+    uint8_t cg = g[aRGB[1]];
+    uint8_t cb = b[aRGB[2]];
+    aCalibratedRGB[0] = cr;
+    aCalibratedRGB[1] = cg;
+    aCalibratedRGB[2] = cb;
+    sum += cr+cg+cb;
+    aRGB += 3;
+    aCalibratedRGB += 3;
+  }
+  return sum;
+}
@@ -0,0 +1,93 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __lethd_ledcalibration_hpp__
+#define __lethd_ledcalibration_hpp__
+
+#include "p44utils_common.hpp"
+
+namespace p44 {
+
+  /// Final output stage of a LED chain: gamma, white balance and brightness, combined into one
+  /// lookup table per color channel, so applying them costs a single table lookup per color component
+  class LEDCalibration
+  {
+    double gamma; ///< gamma exponent, 1=linear
+    double whiteBalance[3]; ///< scaling factors 0..1 for red, green, blue
+    uint8_t brightness; ///< overall brightness 0..255
+    uint8_t powerLimit; ///< additional scaling 0..255 to stay within power budget
+    double gammaTable[256]; ///< gamma corrected component values 0..1
+    uint8_t tables[3][256]; ///< combined tables for red, green, blue
+    bool identity; ///< set if tables do not change any value
+
+  public:
+
+    /// create calibration that does not change any colors
+    LEDCalibration();
+
+    /// set gamma
+    /// @param aGamma gamma exponent, 1 for linear output
+    void setGamma(double aGamma);
+
+    /// @return gamma exponent
+    double getGamma() const { return gamma; }
+
+    /// set white balance
+    /// @param aRed,aGreen,aBlue scaling factors 0..1 for the color channels
+    void setWhiteBalance(double aRed, double aGreen, double aBlue);
+
+    /// set brightness
+    /// @param aBrightness 0..255
+    /// @return true if brightness has changed
+    bool setBrightness(uint8_t aBrightness);
+
+    /// @return brightness 0..255
+    uint8_t getBrightness() const { return brightness; }
+
+    /// set power limit
+    /// @param aPowerLimit 0..255, scales output like brightness, but is meant to be set automatically
+    ///   to keep power consumption within limits
+    /// @return true if power limit has changed
+    bool setPowerLimit(uint8_t aPowerLimit);
+
+    /// @return power limit 0..255
+    uint8_t getPowerLimit() const { return powerLimit; }
+
+    /// @return true if calibration does not change any colors
+    bool isIdentity() const { return identity; }
+
+    /// apply calibration
+    /// @param aRGB 3*aNumLeds bytes: red, green, blue for every LED
+    /// @param aCalibratedRGB where to store the calibrated colors, can be same as aRGB
+    /// @param aNumLeds number of LEDs
+    /// @return sum of all calibrated color components, as a measure for the power needed to show them
+    uint32_t apply(const uint8_t *aRGB, uint8_t *aCalibratedRGB, int aNumLeds) const;
+
+  private:
+
+    void updateGammaTable();
+    void updateTables();
+
+  };
+
+} // namespace p44
+
+#endif /* __lethd_ledcalibration_hpp__ */
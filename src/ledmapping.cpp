@@ -0,0 +1,76 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "ledmapping.hpp"
+
+using namespace p44;
+
+
+// MARK: ===== LEDMapping
+
+LEDMapping::LEDMapping(int aCanvasDx, int aCanvasDy) :
+  canvasDx(aCanvasDx),
+  canvasDy(aCanvasDy)
+{
+}
+
+
+void LEDMapping::addModule(int aX, int aY, int aDx, int aDy, ModuleFlags aFlags)
+{
+  if (aDx<=0 || aDy<=0) return;
+  // outer loop runs over the lines (rows or columns) in wiring order, inner loop along a line
+  bool byColumns = aFlags & columns;
+  int lines = byColumns ? aDx : aDy;
+  int lineLength = byColumns ? aDy : aDx;
+  ledPixels.reserve(ledPixels.size()+aDx*aDy);
+  for (int l=0; l<lines; ++l) {
+    for (int i=0; i<lineLength; ++i) {
+      int along = (aFlags & serpentine) && (l & 0x1) ? lineLength-1-i : i;
+      int mx = byColumns ? l : along;
+      int my = byColumns ? along : l;
+      if (aFlags & mirrorX) mx = aDx-1-mx;
+      if (aFlags & mirrorY) my = aDy-1-my;
+      int x = aX+mx;
+      int y = aY+my;
+      ledPixels.push_back(x>=0 && x<canvasDx && y>=0 && y<canvasDy ? y*canvasDx+x : -1);
+    }
+  }
+}
+
+
+void LEDMapping::addGap(int aNumLeds)
+{
+  if (aNumLeds>0) ledPixels.resize(ledPixels.size()+aNumLeds, -1);
+}
+
+
+void LEDMapping::mapCanvas(const uint8_t *aCanvas, int aBytesPerPixel, uint8_t *aLedRGB) const
+{
+  const int32_t *m = &ledPixels[0];
+  const int32_t *mEnd = m+ledPixels.size();
+  for (; m<mEnd; ++m, aLedRGB+=3) {
+    if (*m<0) continue;
+    const uint8_t *p = aCanvas+*m*aBytesPerPixel;
+    aLedRGB[0] = p[0];
+    aLedRGB[1] = p[1];
+    aLedRGB[2] = p[2];
+  }
+}
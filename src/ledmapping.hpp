@@ -0,0 +1,81 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __lethd_ledmapping_hpp__
+#define __lethd_ledmapping_hpp__
+
+#include "p44utils_common.hpp"
+
+namespace p44 {
+
+  /// Maps the LEDs of a chain to the pixels of a rectangular canvas.
+  /// The chain is described as a sequence of modules (rectangular LED arrangements placed on the canvas)
+  /// and gaps (LEDs not showing canvas pixels). From that, a table with the canvas pixel for every LED
+  /// in the chain is built once, so filling the chain is a single linear pass over that table.
+  class LEDMapping : public P44Obj
+  {
+    int canvasDx; ///< canvas width
+    int canvasDy; ///< canvas height
+    std::vector<int32_t> ledPixels; ///< for every LED in the chain: index of canvas pixel (y*canvasDx+x), -1 if LED is not mapped
+
+  public:
+
+    enum {
+      columns = 0x01, ///< LEDs within the module are wired column by column rather than row by row
+      serpentine = 0x02, ///< direction changes after every row (or column)
+      mirrorX = 0x04, ///< first LED is at the far X end of the module
+      mirrorY = 0x08, ///< first LED is at the far Y end of the module
+    };
+    typedef uint8_t ModuleFlags;
+
+    /// create empty mapping
+    /// @param aCanvasDx,aCanvasDy size of the canvas
+    LEDMapping(int aCanvasDx, int aCanvasDy);
+
+    /// append a module to the chain
+    /// @param aX,aY position of the module's origin on the canvas, module parts outside the canvas are not mapped
+    /// @param aDx,aDy size of the module in LEDs
+    /// @param aFlags wiring of the module
+    void addModule(int aX, int aY, int aDx, int aDy, ModuleFlags aFlags);
+
+    /// append LEDs not showing any canvas pixel to the chain
+    /// @param aNumLeds number of LEDs
+    void addGap(int aNumLeds);
+
+    /// @return number of LEDs in the chain
+    int getNumLeds() const { return (int)ledPixels.size(); }
+
+    /// @param aLedIndex index of the LED in the chain
+    /// @return index of the canvas pixel (y*canvasDx+x) shown by the LED, -1 if none
+    int pixelIndex(int aLedIndex) const { return aLedIndex>=0 && aLedIndex<getNumLeds() ? ledPixels[aLedIndex] : -1; }
+
+    /// fill the colors of the LEDs from the canvas
+    /// @param aCanvas canvas pixels, row by row, aBytesPerPixel per pixel with red, green, blue in the first three bytes
+    /// @param aBytesPerPixel size of a canvas pixel
+    /// @param aLedRGB 3 bytes (red, green, blue) for every LED in the chain. Colors of LEDs not mapped are not touched.
+    void mapCanvas(const uint8_t *aCanvas, int aBytesPerPixel, uint8_t *aLedRGB) const;
+
+  };
+  typedef boost::intrusive_ptr<LEDMapping> LEDMappingPtr;
+
+} // namespace p44
+
+#endif /* __lethd_ledmapping_hpp__ */
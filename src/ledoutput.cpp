@@ -0,0 +1,409 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "ledoutput.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace p44;
+
+
+// MARK: ===== LEDOutput
+
+LEDOutput::LEDOutput(uint16_t aNumLeds, uint16_t aLedsPerRow, bool aXReversed, bool aAlternating) :
+  numLeds(aNumLeds),
+  ledsPerRow(aLedsPerRow>0 ? aLedsPerRow : aNumLeds),
+  xReversed(aXReversed),
+  alternating(aAlternating)
+{
+  numRows = ledsPerRow>0 ? (numLeds+ledsPerRow-1)/ledsPerRow : 0;
+}
+
+
+LEDOutput::~LEDOutput()
+{
+}
+
+
+LEDOutputPtr LEDOutput::newOutput(const string aOutputSpec, uint16_t aNumLeds, uint16_t aLedsPerRow, bool aXReversed, bool aAlternating)
+{
+  LEDOutputPtr output;
+  if (aOutputSpec=="memory") {
+    output = LEDOutputPtr(new MemoryLEDOutput(aNumLeds, aLedsPerRow, aXReversed, aAlternating));
+  }
+  else if (aOutputSpec.substr(0,5)=="file:") {
+    output = LEDOutputPtr(new FileLEDOutput(aOutputSpec.substr(5), aNumLeds, aLedsPerRow, aXReversed, aAlternating));
+  }
+  else {
+    output = LEDOutputPtr(new LEDChainOutput(aOutputSpec, aNumLeds, aLedsPerRow, aXReversed, aAlternating));
+  }
+  FrameCapturePtr capture = FrameCapture::currentCapture();
+  if (capture) {
+    output = LEDOutputPtr(new CapturingLEDOutput(output, aOutputSpec, capture, aNumLeds, aLedsPerRow, aXReversed, aAlternating));
+  }
+  return output;
+}
+
+
+uint16_t LEDOutput::ledIndexFromXY(uint16_t aX, uint16_t aY)
+{
+  uint16_t ledIndex = aY*ledsPerRow;
+  bool reversed = xReversed;
+  if (alternating && (aY & 0x1)) reversed = !reversed;
+  if (reversed) {
+    ledIndex += ledsPerRow-1-aX;
+  }
+  else {
+    ledIndex += aX;
+  }
+  return ledIndex;
+}
+
+
+void LEDOutput::setColorXY(uint16_t aX, uint16_t aY, uint8_t aRed, uint8_t aGreen, uint8_t aBlue)
+{
+  if (aX>=ledsPerRow || aY>=numRows) return;
+  uint16_t ledIndex = ledIndexFromXY(aX, aY);
+  if (ledIndex<numLeds) setColor(ledIndex, aRed, aGreen, aBlue);
+}
+
+
+void LEDOutput::setRowColorsXY(uint16_t aX, uint16_t aY, uint16_t aNumLeds, const uint8_t *aRGB)
+{
+  if (aX>=ledsPerRow || aY>=numRows) return;
+  if (aX+aNumLeds>ledsPerRow) aNumLeds = ledsPerRow-aX;
+  if (aNumLeds==0) return;
+  // a run within a row is a run in the chain, too, possibly in reverse order
+  bool reversed = xReversed;
+  if (alternating && (aY & 0x1)) reversed = !reversed;
+  uint16_t first = ledIndexFromXY(reversed ? aX+aNumLeds-1 : aX, aY);
+  setColors(first, aNumLeds, aRGB, reversed);
+}
+
+
+void LEDOutput::setColors(uint16_t aLedNumber, uint16_t aNumLeds, const uint8_t *aRGB, bool aReversed)
+{
+  if (aReversed) {
+    for (int i=aNumLeds-1; i>=0; --i, aRGB+=3) setColor(aLedNumber+i, aRGB[0], aRGB[1], aRGB[2]);
+  }
+  else {
+    for (int i=0; i<aNumLeds; ++i, aRGB+=3) setColor(aLedNumber+i, aRGB[0], aRGB[1], aRGB[2]);
+  }
+}
+
+
+void LEDOutput::copyColors(uint8_t *aBuffer, uint16_t aLedNumber, uint16_t aNumLeds, const uint8_t *aRGB, bool aReversed)
+{
+  if (aLedNumber>=numLeds) return;
+  if (aLedNumber+aNumLeds>numLeds) {
+    // clip, keeping the LEDs at the start of the chain
+    uint16_t n = numLeds-aLedNumber;
+    if (aReversed) aRGB += 3*(aNumLeds-n); // first triplets are for the LEDs beyond the end
+    aNumLeds = n;
+  }
+  uint8_t *p = aBuffer+3*aLedNumber;
+  if (aReversed) {
+    const uint8_t *s = aRGB+3*aNumLeds;
+    while (s>aRGB) {
+      s -= 3;
+      p[0] = s[0];
+      p[1] = s[1];
+      p[2] = s[2];
+      p += 3;
+    }
+  }
+  else {
+    memcpy(p, aRGB, 3*aNumLeds);
+  }
+}
+
+
+void LEDOutput::clear()
+{
+  for (uint16_t i=0; i<numLeds; ++i) {
+    setColor(i, 0, 0, 0);
+  }
+}
+
+
+// MARK: ===== LEDChainOutput
+
+LEDChainOutput::LEDChainOutput(const string aDeviceName, uint16_t aNumLeds, uint16_t aLedsPerRow, bool aXReversed, bool aAlternating) :
+  inherited(aNumLeds, aLedsPerRow, aXReversed, aAlternating)
+{
+  // X/Y mapping is done by LEDOutput, so chain is addressed linearly
+  chain = LEDChainCommPtr(new LEDChainComm(LEDChainComm::ledtype_ws281x, aDeviceName, aNumLeds));
+}
+
+
+bool LEDChainOutput::begin()
+{
+  return chain->begin();
+}
+
+
+void LEDChainOutput::end()
+{
+  chain->end();
+}
+
+
+void LEDChainOutput::setColor(uint16_t aLedNumber, uint8_t aRed, uint8_t aGreen, uint8_t aBlue)
+{
+  chain->setColor(aLedNumber, aRed, aGreen, aBlue);
+}
+
+
+void LEDChainOutput::clear()
+{
+  chain->clear();
+}
+
+
+void LEDChainOutput::show()
+{
+  chain->show();
+}
+
+
+// MARK: ===== MemoryLEDOutput
+
+MemoryLEDOutput::MemoryLEDOutput(uint16_t aNumLeds, uint16_t aLedsPerRow, bool aXReversed, bool aAlternating) :
+  inherited(aNumLeds, aLedsPerRow, aXReversed, aAlternating),
+  shows(0)
+{
+  pixels.resize(numLeds*3, 0);
+  shownPixels.resize(numLeds*3, 0);
+}
+
+
+bool MemoryLEDOutput::begin()
+{
+  return true;
+}
+
+
+void MemoryLEDOutput::end()
+{
+}
+
+
+void MemoryLEDOutput::setColor(uint16_t aLedNumber, uint8_t aRed, uint8_t aGreen, uint8_t aBlue)
+{
+  if (aLedNumber>=numLeds) return;
+  uint8_t *p = &pixels[aLedNumber*3];
+  p[0] = aRed;
+  p[1] = aGreen;
+  p[2] = aBlue;
+}
+
+
+void MemoryLEDOutput::setColors(uint16_t aLedNumber, uint16_t aNumLeds, const uint8_t *aRGB, bool aReversed)
+{
+  copyColors(&pixels[0], aLedNumber, aNumLeds, aRGB, aReversed);
+}
+
+
+void MemoryLEDOutput::show()
+{
+  shownPixels = pixels;
+  shows++;
+}
+
+
+// MARK: ===== FileLEDOutput
+
+FileLEDOutput::FileLEDOutput(const string aPath, uint16_t aNumLeds, uint16_t aLedsPerRow, bool aXReversed, bool aAlternating) :
+  inherited(aNumLeds, aLedsPerRow, aXReversed, aAlternating),
+  path(aPath),
+  fd(-1),
+  pendingBytes(0),
+  droppedFrames(0)
+{
+  pixels.resize(numLeds*3, 0);
+  outBuffer.resize(numLeds*3, 0);
+}
+
+
+FileLEDOutput::~FileLEDOutput()
+{
+  end();
+}
+
+
+bool FileLEDOutput::openOutput()
+{
+  if (fd>=0) return true;
+  struct stat st;
+  if (stat(path.c_str(), &st)==0 && S_ISFIFO(st.st_mode)) {
+    // non-blocking open fails with ENXIO as long as there is no reader
+    fd = open(path.c_str(), O_WRONLY|O_NONBLOCK);
+  }
+  else {
+    fd = open(path.c_str(), O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+    if (fd<0) {
+      LOG(LOG_ERR, "Cannot open LED output file '%s': %s", path.c_str(), strerror(errno));
+    }
+  }
+  return fd>=0;
+}
+
+
+bool FileLEDOutput::begin()
+{
+  // a FIFO without reader is not an error, we'll retry opening at every show()
+  openOutput();
+  return true;
+}
+
+
+void FileLEDOutput::end()
+{
+  if (fd>=0) {
+    close(fd);
+    fd = -1;
+  }
+  // a new reader must start with a complete frame
+  pendingBytes = 0;
+}
+
+
+void FileLEDOutput::setColor(uint16_t aLedNumber, uint8_t aRed, uint8_t aGreen, uint8_t aBlue)
+{
+  if (aLedNumber>=numLeds) return;
+  uint8_t *p = &pixels[aLedNumber*3];
+  p[0] = aRed;
+  p[1] = aGreen;
+  p[2] = aBlue;
+}
+
+
+void FileLEDOutput::setColors(uint16_t aLedNumber, uint16_t aNumLeds, const uint8_t *aRGB, bool aReversed)
+{
+  copyColors(&pixels[0], aLedNumber, aNumLeds, aRGB, aReversed);
+}
+
+
+void FileLEDOutput::show()
+{
+  if (!openOutput()) {
+    droppedFrames++;
+    return;
+  }
+  if (pendingBytes>0) {
+    // previous frame was only partially written (frames larger than PIPE_BUF can be), must complete it
+    // first, otherwise the reader would lose frame sync
+    if (!writePending() || pendingBytes>0) {
+      droppedFrames++;
+      return;
+    }
+  }
+  outBuffer = pixels;
+  pendingBytes = outBuffer.size();
+  if (!writePending()) {
+    droppedFrames++;
+  }
+}
+
+
+bool FileLEDOutput::writePending()
+{
+  ssize_t res = write(fd, &outBuffer[outBuffer.size()-pendingBytes], pendingBytes);
+  if (res<0) {
+    if (errno!=EAGAIN) {
+      // reader has gone away (EPIPE) or file error: reopen at next show()
+      LOG(LOG_WARNING, "LED output '%s' write error: %s", path.c_str(), strerror(errno));
+      end();
+      return false;
+    }
+    // nothing written, frame can be dropped as a whole
+    if (pendingBytes==outBuffer.size()) {
+      pendingBytes = 0;
+      return false;
+    }
+    return true;
+  }
+  pendingBytes -= res;
+  return true;
+}
+
+
+// MARK: ===== CapturingLEDOutput
+
+CapturingLEDOutput::CapturingLEDOutput(LEDOutputPtr aOutput, const string aOutputSpec, FrameCapturePtr aCapture, uint16_t aNumLeds, uint16_t aLedsPerRow, bool aXReversed, bool aAlternating) :
+  inherited(aNumLeds, aLedsPerRow, aXReversed, aAlternating),
+  output(aOutput),
+  capture(aCapture)
+{
+  pixels.resize(numLeds*3, 0);
+  CaptureChannel c;
+  c.outputSpec = aOutputSpec;
+  c.numLeds = aNumLeds;
+  c.ledsPerRow = aLedsPerRow;
+  c.xReversed = aXReversed;
+  c.alternating = aAlternating;
+  channel = capture->addChannel(c);
+}
+
+
+bool CapturingLEDOutput::begin()
+{
+  return output->begin();
+}
+
+
+void CapturingLEDOutput::end()
+{
+  output->end();
+}
+
+
+void CapturingLEDOutput::setColor(uint16_t aLedNumber, uint8_t aRed, uint8_t aGreen, uint8_t aBlue)
+{
+  if (aLedNumber>=numLeds) return;
+  uint8_t *p = &pixels[aLedNumber*3];
+  p[0] = aRed;
+  p[1] = aGreen;
+  p[2] = aBlue;
+  output->setColor(aLedNumber, aRed, aGreen, aBlue);
+}
+
+
+void CapturingLEDOutput::setColors(uint16_t aLedNumber, uint16_t aNumLeds, const uint8_t *aRGB, bool aReversed)
+{
+  copyColors(&pixels[0], aLedNumber, aNumLeds, aRGB, aReversed);
+  output->setColors(aLedNumber, aNumLeds, aRGB, aReversed);
+}
+
+
+void CapturingLEDOutput::clear()
+{
+  std::fill(pixels.begin(), pixels.end(), 0);
+  output->clear();
+}
+
+
+void CapturingLEDOutput::show()
+{
+  output->show();
+  capture->recordFrame(channel, &pixels[0], numLeds);
+}
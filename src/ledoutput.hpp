@@ -0,0 +1,247 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __lethd_ledoutput_hpp__
+#define __lethd_ledoutput_hpp__
+
+#include "p44utils_common.hpp"
+
+#include "ledchaincomm.hpp"
+#include "framecapture.hpp"
+
+namespace p44 {
+
+  class LEDOutput;
+  typedef boost::intrusive_ptr<LEDOutput> LEDOutputPtr;
+
+  /// Destination for the pixels of a LED chain.
+  /// Maps X/Y coordinates to LED numbers the same way LEDChainComm does, so all outputs
+  /// receive the LEDs in the order they have on the wire.
+  class LEDOutput : public P44Obj
+  {
+  protected:
+
+    uint16_t numLeds; ///< number of LEDs in the chain
+    uint16_t ledsPerRow; ///< number of LEDs per row (X direction)
+    uint16_t numRows; ///< number of rows (Y direction)
+    bool xReversed; ///< even (0,2,4...) rows go backwards
+    bool alternating; ///< direction changes after every row
+
+  public:
+
+    /// create output
+    /// @param aNumLeds number of LEDs in the chain
+    /// @param aLedsPerRow number of LEDs per row, 0 for single row
+    /// @param aXReversed X direction is reversed
+    /// @param aAlternating X direction is reversed in every other row (serpentine wiring)
+    LEDOutput(uint16_t aNumLeds, uint16_t aLedsPerRow = 0, bool aXReversed = false, bool aAlternating = false);
+    virtual ~LEDOutput();
+
+    /// create an output according to a specification string
+    /// @param aOutputSpec specifies the output:
+    ///   - "memory" : output into a memory buffer only (for tests and benchmarks)
+    ///   - "file:<path>" : write every shown frame as raw RGB bytes into a file or FIFO
+    ///   - anything else: the device name of a WS281x LED chain
+    ///   When a frame capture is running (see FrameCapture::startCapture()), the output is wrapped
+    ///   such that all shown frames are recorded.
+    /// @param aNumLeds number of LEDs in the chain
+    /// @param aLedsPerRow number of LEDs per row, 0 for single row
+    /// @param aXReversed X direction is reversed
+    /// @param aAlternating X direction is reversed in every other row (serpentine wiring)
+    /// @return new output (not yet begun)
+    static LEDOutputPtr newOutput(const string aOutputSpec, uint16_t aNumLeds, uint16_t aLedsPerRow = 0, bool aXReversed = false, bool aAlternating = false);
+
+    /// start using the output
+    /// @return true if output is ready
+    virtual bool begin() = 0;
+
+    /// stop using the output
+    virtual void end() = 0;
+
+    /// set color of a single LED
+    /// @param aLedNumber number of the LED in the chain
+    /// @param aRed,aGreen,aBlue color components
+    virtual void setColor(uint16_t aLedNumber, uint8_t aRed, uint8_t aGreen, uint8_t aBlue) = 0;
+
+    /// set colors of consecutive LEDs
+    /// @param aLedNumber number of the first LED in the chain
+    /// @param aNumLeds number of LEDs to set
+    /// @param aRGB 3*aNumLeds bytes: red, green, blue for every LED
+    /// @param aReversed if set, aRGB contains the LEDs in reverse chain order, i.e. the first
+    ///   RGB triplet is for LED aLedNumber+aNumLeds-1
+    /// @note base class calls setColor() for every LED, outputs keeping a pixel buffer should override
+    ///   this to copy directly into their buffer
+    virtual void setColors(uint16_t aLedNumber, uint16_t aNumLeds, const uint8_t *aRGB, bool aReversed = false);
+
+    /// set color of LED by X/Y coordinates
+    /// @param aX,aY position
+    /// @param aRed,aGreen,aBlue color components
+    void setColorXY(uint16_t aX, uint16_t aY, uint8_t aRed, uint8_t aGreen, uint8_t aBlue);
+
+    /// set colors of a horizontal run of LEDs by X/Y coordinates
+    /// @param aX,aY position of the first LED
+    /// @param aNumLeds number of LEDs in X direction, clipped to the row
+    /// @param aRGB 3*aNumLeds bytes: red, green, blue for every LED, in X order
+    /// @note the X/Y mapping is calculated once for the entire run
+    void setRowColorsXY(uint16_t aX, uint16_t aY, uint16_t aNumLeds, const uint8_t *aRGB);
+
+    /// set all LEDs to black
+    virtual void clear();
+
+    /// make the colors set since last show() visible
+    virtual void show() = 0;
+
+    /// @return number of LEDs in the chain
+    uint16_t getNumLeds() { return numLeds; }
+
+    /// @param aX,aY position
+    /// @return LED number in the chain
+    uint16_t ledIndexFromXY(uint16_t aX, uint16_t aY);
+
+  protected:
+
+    /// helper for implementations of setColors() keeping a pixel buffer
+    /// @param aBuffer RGB bytes of all LEDs, 3 per LED in chain order
+    /// @note parameters as for setColors(), LEDs beyond numLeds are ignored
+    void copyColors(uint8_t *aBuffer, uint16_t aLedNumber, uint16_t aNumLeds, const uint8_t *aRGB, bool aReversed);
+
+  };
+
+
+  /// output to a real WS281x LED chain
+  class LEDChainOutput : public LEDOutput
+  {
+    typedef LEDOutput inherited;
+
+    LEDChainCommPtr chain;
+
+  public:
+
+    LEDChainOutput(const string aDeviceName, uint16_t aNumLeds, uint16_t aLedsPerRow = 0, bool aXReversed = false, bool aAlternating = false);
+
+    virtual bool begin() P44_OVERRIDE;
+    virtual void end() P44_OVERRIDE;
+    virtual void setColor(uint16_t aLedNumber, uint8_t aRed, uint8_t aGreen, uint8_t aBlue) P44_OVERRIDE;
+    virtual void clear() P44_OVERRIDE;
+    virtual void show() P44_OVERRIDE;
+
+  };
+
+
+  /// output into memory only, for tests and benchmarks to inspect what would have been shown
+  class MemoryLEDOutput : public LEDOutput
+  {
+    typedef LEDOutput inherited;
+
+    std::vector<uint8_t> pixels; ///< RGB bytes of all LEDs as currently set
+    std::vector<uint8_t> shownPixels; ///< RGB bytes of all LEDs as of last show()
+    long shows; ///< number of show() calls
+
+  public:
+
+    MemoryLEDOutput(uint16_t aNumLeds, uint16_t aLedsPerRow = 0, bool aXReversed = false, bool aAlternating = false);
+
+    virtual bool begin() P44_OVERRIDE;
+    virtual void end() P44_OVERRIDE;
+    virtual void setColor(uint16_t aLedNumber, uint8_t aRed, uint8_t aGreen, uint8_t aBlue) P44_OVERRIDE;
+    virtual void setColors(uint16_t aLedNumber, uint16_t aNumLeds, const uint8_t *aRGB, bool aReversed = false) P44_OVERRIDE;
+    virtual void show() P44_OVERRIDE;
+
+    /// @return RGB bytes (3 per LED, in chain order) of the frame shown last
+    const uint8_t *getShownPixels() { return &shownPixels[0]; }
+
+    /// @return number of show() calls so far
+    long getShowCount() { return shows; }
+
+  };
+  typedef boost::intrusive_ptr<MemoryLEDOutput> MemoryLEDOutputPtr;
+
+
+  /// output writing every shown frame as raw RGB bytes (3 per LED, in chain order) to a file or FIFO
+  /// @note a FIFO is opened non-blocking, so a missing or slow reader only causes frames to be dropped,
+  ///   and never stalls rendering. Frames are always written completely, a partially written frame is
+  ///   completed before the next one.
+  /// @note SIGPIPE must be ignored by the process, otherwise a FIFO reader going away terminates it
+  class FileLEDOutput : public LEDOutput
+  {
+    typedef LEDOutput inherited;
+
+    string path;
+    int fd;
+    std::vector<uint8_t> pixels; ///< RGB bytes of all LEDs
+    std::vector<uint8_t> outBuffer; ///< RGB bytes of the frame being written
+    size_t pendingBytes; ///< number of bytes at the end of outBuffer not yet written
+    long droppedFrames; ///< number of frames that could not be written
+
+  public:
+
+    FileLEDOutput(const string aPath, uint16_t aNumLeds, uint16_t aLedsPerRow = 0, bool aXReversed = false, bool aAlternating = false);
+    virtual ~FileLEDOutput();
+
+    virtual bool begin() P44_OVERRIDE;
+    virtual void end() P44_OVERRIDE;
+    virtual void setColor(uint16_t aLedNumber, uint8_t aRed, uint8_t aGreen, uint8_t aBlue) P44_OVERRIDE;
+    virtual void setColors(uint16_t aLedNumber, uint16_t aNumLeds, const uint8_t *aRGB, bool aReversed = false) P44_OVERRIDE;
+    virtual void show() P44_OVERRIDE;
+
+    /// @return number of frames that could not be written (e.g. no reader on FIFO)
+    long getDroppedFrames() { return droppedFrames; }
+
+  private:
+
+    bool openOutput();
+
+    /// write (remainder of) the frame in outBuffer
+    /// @return false if the frame was dropped entirely (nothing written, or write error)
+    bool writePending();
+
+  };
+
+
+  /// output recording every shown frame into a frame capture before passing it on to the actual output
+  class CapturingLEDOutput : public LEDOutput
+  {
+    typedef LEDOutput inherited;
+
+    LEDOutputPtr output; ///< the actual output
+    FrameCapturePtr capture;
+    int channel; ///< channel in the capture
+    std::vector<uint8_t> pixels; ///< RGB bytes of all LEDs
+
+  public:
+
+    /// @param aOutput the actual output
+    /// @param aOutputSpec the specification aOutput was created from, to be recorded in the capture
+    /// @param aCapture the capture to record frames into
+    CapturingLEDOutput(LEDOutputPtr aOutput, const string aOutputSpec, FrameCapturePtr aCapture, uint16_t aNumLeds, uint16_t aLedsPerRow = 0, bool aXReversed = false, bool aAlternating = false);
+
+    virtual bool begin() P44_OVERRIDE;
+    virtual void end() P44_OVERRIDE;
+    virtual void setColor(uint16_t aLedNumber, uint8_t aRed, uint8_t aGreen, uint8_t aBlue) P44_OVERRIDE;
+    virtual void setColors(uint16_t aLedNumber, uint16_t aNumLeds, const uint8_t *aRGB, bool aReversed = false) P44_OVERRIDE;
+    virtual void clear() P44_OVERRIDE;
+    virtual void show() P44_OVERRIDE;
+
+  };
+
+} // namespace p44
+
+#endif /* __lethd_ledoutput_hpp__ */
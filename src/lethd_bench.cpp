@@ -0,0 +1,1154 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of lethd.
+//
+//  lethd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  lethd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with lethd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Headless rendering benchmark for the view classes, no LED hardware needed
+//
+// Usage: lethd-bench [scenes|components] (default: both)
+// - scenes: full frame renders of representative scenes on several panel sizes
+// - components: micro benchmarks and result verification of rendering building blocks
+// Usage: lethd-bench compare <capturefile1> <capturefile2>
+// - compares the output recorded with lethd --capture, e.g. before and after an optimisation
+
+#include "textview.hpp"
+#include "imageview.hpp"
+#include "viewscroller.hpp"
+#include "viewstack.hpp"
+#include "viewanimator.hpp"
+#include "rendercacheview.hpp"
+#include "ledchaincomm.hpp" // for brightnessToPwm and pwmToBrightness
+#include "ledoutput.hpp"
+#include "ledmapping.hpp"
+#include "ledcalibration.hpp"
+#include "framecapture.hpp"
+
+using namespace p44;
+
+
+// MARK: ===== helpers
+
+#define MIN_MEASURE_TIME (200*MilliSecond)
+
+typedef boost::function<void ()> RenderCB;
+
+/// measure rendering speed
+/// @param aRender renders a frame
+/// @param aPixelsPerFrame number of pixels rendered by one aRender call
+/// @return pixels per second
+static double pixelsPerSecond(RenderCB aRender, long aPixelsPerFrame)
+{
+  long frames = 0;
+  MLMicroSeconds start = MainLoop::now();
+  MLMicroSeconds elapsed;
+  do {
+    aRender();
+    frames++;
+    elapsed = MainLoop::now()-start;
+  } while (elapsed<MIN_MEASURE_TIME);
+  return (double)frames*aPixelsPerFrame*Second/elapsed;
+}
+
+
+static uint32_t pixelSum; // prevents rendering from being optimized away
+
+
+// MARK: ===== orientation/wrap transformation benchmark
+
+/// TextView with the coordinate transformation as it was before it was precomputed
+class LegacyTransformTextView : public TextView
+{
+public:
+
+  PixelColor legacyColorAt(int aX, int aY)
+  {
+    PixelColor pc = backgroundColor;
+    if (alpha==0) {
+      pc.a = 0;
+    }
+    else {
+      int x = aX-originX-offsetX;
+      int y = aY-originY-offsetY;
+      if (contentOrientation & xy_swap) {
+        swap(x, y);
+      }
+      if (contentOrientation & x_flip) {
+        x = contentSizeX-x-1;
+      }
+      if (contentOrientation & y_flip) {
+        y = contentSizeY-y-1;
+      }
+      if (contentWrapMode&clipXY && (
+        ((contentWrapMode&clipXmin) && x<0) ||
+        ((contentWrapMode&clipXmax) && x>=contentSizeX) ||
+        ((contentWrapMode&clipYmin) && y<0) ||
+        ((contentWrapMode&clipYmax) && y>=contentSizeY)
+      )) {
+        pc.a = 0;
+      }
+      else {
+        if (contentSizeX>0) {
+          while ((contentWrapMode&wrapXmin) && x<0) x+=contentSizeX;
+          while ((contentWrapMode&wrapXmax) && x>=contentSizeX) x-=contentSizeX;
+        }
+        if (contentSizeY>0) {
+          while ((contentWrapMode&wrapYmin) && y<0) y+=contentSizeY;
+          while ((contentWrapMode&wrapYmax) && y>=contentSizeY) y-=contentSizeY;
+        }
+        pc = contentColorAt(x, y);
+        if (pc.a==0) {
+          pc = backgroundColor;
+        }
+        if (alpha!=255) {
+          pc.a = dimVal(pc.a, alpha);
+        }
+      }
+    }
+    return pc;
+  }
+
+};
+typedef boost::intrusive_ptr<LegacyTransformTextView> LegacyTransformTextViewPtr;
+
+
+static void renderLegacy(LegacyTransformTextViewPtr aView, int aSizeX, int aSizeY)
+{
+  for (int y=0; y<aSizeY; y++) {
+    for (int x=0; x<aSizeX; x++) {
+      pixelSum += aView->legacyColorAt(x, y).r;
+    }
+  }
+}
+
+
+static void renderColorAt(ViewPtr aView, int aSizeX, int aSizeY)
+{
+  for (int y=0; y<aSizeY; y++) {
+    for (int x=0; x<aSizeX; x++) {
+      pixelSum += aView->colorAt(x, y).r;
+    }
+  }
+}
+
+
+static void renderRows(ViewPtr aView, int aSizeX, int aSizeY)
+{
+  std::vector<PixelColor> row(aSizeX);
+  for (int y=0; y<aSizeY; y++) {
+    aView->rowColorsAt(0, y, aSizeX, &row[0]);
+    pixelSum += row[0].r;
+  }
+}
+
+
+static void orientationBenchmark()
+{
+  const int sizeX = 72;
+  const int sizeY = 7;
+  const char *orientationNames[8] = { "right", "swap", "xflip", "down", "yflip", "up", "left", "swap+flip" };
+  printf("Orientation/wrap transformation, %dx%d pixels, wrapped text, Mpixels/s\n", sizeX, sizeY);
+  printf("%-12s %-8s %12s %12s %12s\n", "orientation", "offset", "legacy", "colorAt", "rowColorsAt");
+  for (int o=0; o<8; o++) {
+    for (int far=0; far<2; far++) {
+      LegacyTransformTextViewPtr v = LegacyTransformTextViewPtr(new LegacyTransformTextView);
+      v->setText("Benchmark text for orientation tests +++ ");
+      v->setFrame(0, 0, sizeX, sizeY);
+      v->setOrientation(o);
+      v->setWrapMode(View::wrapXY);
+      // far offsets make legacy wrapping iterate over many content widths
+      int offs = far ? 100000 : 5;
+      v->setContentOffset(offs, offs);
+      double legacy = pixelsPerSecond(boost::bind(&renderLegacy, v, sizeX, sizeY), sizeX*sizeY);
+      double colorAt = pixelsPerSecond(boost::bind(&renderColorAt, v, sizeX, sizeY), sizeX*sizeY);
+      double rows = pixelsPerSecond(boost::bind(&renderRows, v, sizeX, sizeY), sizeX*sizeY);
+      printf("%d %-10s %-8d %12.2f %12.2f %12.2f\n", o, orientationNames[o], offs, legacy/1e6, colorAt/1e6, rows/1e6);
+    }
+  }
+}
+
+
+// MARK: ===== row utilities (blending kernels)
+
+#define KERNEL_ROW_LEN 1003 // not a multiple of vector sizes, to include tail processing
+
+static PixelColor randomPixel()
+{
+  PixelColor p;
+  p.r = rand() & 0xFF;
+  p.g = rand() & 0xFF;
+  p.b = rand() & 0xFF;
+  switch (rand() & 3) {
+    case 0: p.a = 0; break;
+    case 1: p.a = 255; break;
+    default: p.a = rand() & 0xFF; break;
+  }
+  return p;
+}
+
+
+static bool samePixels(const std::vector<PixelColor> &aPix1, const std::vector<PixelColor> &aPix2)
+{
+  for (size_t i=0; i<aPix1.size(); i++) {
+    const PixelColor &p1 = aPix1[i];
+    const PixelColor &p2 = aPix2[i];
+    if (p1.r!=p2.r || p1.g!=p2.g || p1.b!=p2.b || p1.a!=p2.a) return false;
+  }
+  return true;
+}
+
+
+static bool samePixels(const std::vector<PremultPixelColor> &aPix1, const std::vector<PremultPixelColor> &aPix2)
+{
+  for (size_t i=0; i<aPix1.size(); i++) {
+    const PremultPixelColor &p1 = aPix1[i];
+    const PremultPixelColor &p2 = aPix2[i];
+    if (p1.r!=p2.r || p1.g!=p2.g || p1.b!=p2.b || p1.a!=p2.a) return false;
+  }
+  return true;
+}
+
+
+/// verify that the row utilities produce exactly the same results as the single pixel utilities
+/// @return number of mismatches
+static int verifyKernels()
+{
+  int mismatches = 0;
+  const int n = KERNEL_ROW_LEN;
+  std::vector<PixelColor> base(n), other(n), row(n), ref(n);
+  std::vector<PremultPixelColor> prow(n), pref(n);
+  for (int pass=0; pass<20; pass++) {
+    for (int i=0; i<n; i++) { base[i] = randomPixel(); other[i] = randomPixel(); }
+    uint16_t dim = pass==0 ? 0 : (pass==1 ? 255 : rand() % 400); // includes light up
+    uint8_t amount = pass==0 ? 0 : (pass==1 ? 255 : rand() & 0xFF);
+    // dimPixels
+    row = base; ref = base;
+    dimPixels(&row[0], n, dim);
+    for (int i=0; i<n; i++) dimPixel(ref[i], dim);
+    if (!samePixels(row, ref)) { printf("- dimPixels mismatch (dim=%d)\n", dim); mismatches++; }
+    // alphaDimPixels
+    row = base; ref = base;
+    alphaDimPixels(&row[0], n);
+    for (int i=0; i<n; i++) ref[i] = dimmedPixel(ref[i], ref[i].a);
+    if (!samePixels(row, ref)) { printf("- alphaDimPixels mismatch\n"); mismatches++; }
+    // premultiplyPixels
+    premultiplyPixels(&base[0], &prow[0], n);
+    for (int i=0; i<n; i++) pref[i] = premultipliedPixel(base[i]);
+    if (!samePixels(prow, pref)) { printf("- premultiplyPixels mismatch\n"); mismatches++; }
+    // scalePremultipliedPixels
+    scalePremultipliedPixels(&prow[0], n, amount);
+    for (int i=0; i<n; i++) scalePremultipliedPixel(pref[i], amount);
+    if (!samePixels(prow, pref)) { printf("- scalePremultipliedPixels mismatch (scale=%d)\n", amount); mismatches++; }
+    // addToPixels
+    row = base; ref = base;
+    addToPixels(&row[0], &other[0], n);
+    for (int i=0; i<n; i++) addToPixel(ref[i], other[i]);
+    if (!samePixels(row, ref)) { printf("- addToPixels mismatch\n"); mismatches++; }
+    // overlayPixels
+    row = base; ref = base;
+    overlayPixels(&row[0], &other[0], n);
+    for (int i=0; i<n; i++) overlayPixel(ref[i], other[i]);
+    if (!samePixels(row, ref)) { printf("- overlayPixels mismatch\n"); mismatches++; }
+    // mixinPixels
+    row = base; ref = base;
+    mixinPixels(&row[0], &other[0], n, amount);
+    for (int i=0; i<n; i++) mixinPixel(ref[i], other[i], amount);
+    if (!samePixels(row, ref)) { printf("- mixinPixels mismatch (amount=%d)\n", amount); mismatches++; }
+  }
+  return mismatches;
+}
+
+
+static void blendSingle(std::vector<PixelColor> &aRow, const std::vector<PixelColor> &aOther)
+{
+  for (size_t i=0; i<aRow.size(); i++) {
+    PixelColor p = aOther[i];
+    p = dimmedPixel(p, p.a);
+    addToPixel(aRow[i], p);
+    overlayPixel(aRow[i], aOther[i]);
+  }
+  pixelSum += aRow[0].r;
+}
+
+
+static void blendRow(std::vector<PixelColor> &aRow, std::vector<PixelColor> &aOther, std::vector<PixelColor> &aTemp)
+{
+  aTemp = aOther;
+  alphaDimPixels(&aTemp[0], (int)aTemp.size());
+  addToPixels(&aRow[0], &aTemp[0], (int)aRow.size());
+  overlayPixels(&aRow[0], &aOther[0], (int)aRow.size());
+  pixelSum += aRow[0].r;
+}
+
+
+static int kernelBenchmark()
+{
+  int mismatches = verifyKernels();
+  printf("Row utilities: %s\n", mismatches==0 ? "results identical to single pixel utilities" : "MISMATCHES FOUND");
+  const int n = KERNEL_ROW_LEN;
+  std::vector<PixelColor> row(n), other(n), temp(n);
+  for (int i=0; i<n; i++) { row[i] = randomPixel(); other[i] = randomPixel(); }
+  double single = pixelsPerSecond(boost::bind(&blendSingle, boost::ref(row), boost::cref(other)), n);
+  double rows = pixelsPerSecond(boost::bind(&blendRow, boost::ref(row), boost::ref(other), boost::ref(temp)), n);
+  printf("Alpha dim+add+overlay blending, Mpixels/s: single pixel %.2f, row utilities %.2f\n", single/1e6, rows/1e6);
+  return mismatches;
+}
+
+
+// MARK: ===== energy domain mixing benchmark
+
+/// mixinPixel() as it was before using precomputed tables
+static void legacyMixinPixel(PixelColor &aMainPixel, PixelColor aOutsidePixel, uint8_t aAmountOutside)
+{
+  if (aAmountOutside>0) {
+    if (aMainPixel.a!=255 || aOutsidePixel.a!=255) {
+      // mixed transparency
+      uint8_t alpha = dimVal(aMainPixel.a, pwmToBrightness(255-aAmountOutside)) + dimVal(aOutsidePixel.a, pwmToBrightness(aAmountOutside));
+      if (alpha>0) {
+        uint16_t ab = 65025/alpha;
+        uint16_t r_e = ( (((uint16_t)brightnessToPwm(dimVal(aMainPixel.r, aMainPixel.a))+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(dimVal(aOutsidePixel.r, aOutsidePixel.a))+1)*(aAmountOutside)) )>>8;
+        uint16_t g_e = ( (((uint16_t)brightnessToPwm(dimVal(aMainPixel.g, aMainPixel.a))+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(dimVal(aOutsidePixel.g, aOutsidePixel.a))+1)*(aAmountOutside)) )>>8;
+        uint16_t b_e = ( (((uint16_t)brightnessToPwm(dimVal(aMainPixel.b, aMainPixel.a))+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(dimVal(aOutsidePixel.b, aOutsidePixel.a))+1)*(aAmountOutside)) )>>8;
+        uint16_t r = (((uint16_t)pwmToBrightness(r_e)+1)*ab)>>8;
+        uint16_t g = (((uint16_t)pwmToBrightness(g_e)+1)*ab)>>8;
+        uint16_t b = (((uint16_t)pwmToBrightness(b_e)+1)*ab)>>8;
+        uint16_t m = r; if (g>m) m = g; if (b>m) m = b;
+        if (m>255) {
+          uint16_t cr = 65025/m;
+          r = (r*cr)>>8;
+          g = (g*cr)>>8;
+          b = (b*cr)>>8;
+          alpha = (((uint16_t)alpha+1)*m)>>8;
+          aMainPixel.r = r>255 ? 255 : r;
+          aMainPixel.g = g>255 ? 255 : g;
+          aMainPixel.b = b>255 ? 255 : b;
+          aMainPixel.a = alpha>255 ? 255 : alpha;
+        }
+        else {
+          aMainPixel.r = r;
+          aMainPixel.g = g;
+          aMainPixel.b = b;
+          aMainPixel.a = alpha;
+        }
+      }
+      else {
+        aMainPixel = transparent;
+      }
+    }
+    else {
+      uint16_t r_e = ( (((uint16_t)brightnessToPwm(aMainPixel.r)+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(aOutsidePixel.r)+1)*(aAmountOutside)) )>>8;
+      uint16_t g_e = ( (((uint16_t)brightnessToPwm(aMainPixel.g)+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(aOutsidePixel.g)+1)*(aAmountOutside)) )>>8;
+      uint16_t b_e = ( (((uint16_t)brightnessToPwm(aMainPixel.b)+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(aOutsidePixel.b)+1)*(aAmountOutside)) )>>8;
+      aMainPixel.r = r_e>255 ? 255 : pwmToBrightness(r_e);
+      aMainPixel.g = g_e>255 ? 255 : pwmToBrightness(g_e);
+      aMainPixel.b = b_e>255 ? 255 : pwmToBrightness(b_e);
+      aMainPixel.a = 255;
+    }
+  }
+}
+
+
+static void mixLegacy(std::vector<PixelColor> &aRow, const std::vector<PixelColor> &aOther, uint8_t aAmount)
+{
+  for (size_t i=0; i<aRow.size(); i++) {
+    legacyMixinPixel(aRow[i], aOther[i], aAmount);
+  }
+  pixelSum += aRow[0].r;
+}
+
+
+static void mixRow(std::vector<PixelColor> &aRow, const std::vector<PixelColor> &aOther, uint8_t aAmount)
+{
+  mixinPixels(&aRow[0], &aOther[0], (int)aRow.size(), aAmount);
+  pixelSum += aRow[0].r;
+}
+
+
+static int mixingBenchmark()
+{
+  // verify table based mixing against the original calculation
+  int mismatches = 0;
+  const int n = KERNEL_ROW_LEN;
+  std::vector<PixelColor> base(n), other(n), row(n), ref(n);
+  for (int amount=0; amount<256; amount++) {
+    for (int i=0; i<n; i++) { base[i] = randomPixel(); other[i] = randomPixel(); }
+    row = base; ref = base;
+    mixinPixels(&row[0], &other[0], n, amount);
+    for (int i=0; i<n; i++) legacyMixinPixel(ref[i], other[i], amount);
+    if (!samePixels(row, ref)) mismatches++;
+  }
+  printf("Energy domain mixing: %s\n", mismatches==0 ? "results identical to original calculation" : "MISMATCHES FOUND");
+  // 0.25 pixel steps use these amounts
+  printf("%-8s %12s %12s\n", "amount", "legacy", "tables");
+  const uint8_t amounts[3] = { 64, 128, 192 };
+  for (int k=0; k<3; k++) {
+    for (int i=0; i<n; i++) { row[i] = randomPixel(); other[i] = randomPixel(); }
+    double legacy = pixelsPerSecond(boost::bind(&mixLegacy, boost::ref(row), boost::cref(other), amounts[k]), n);
+    double tables = pixelsPerSecond(boost::bind(&mixRow, boost::ref(row), boost::cref(other), amounts[k]), n);
+    printf("%-8d %12.2f %12.2f Mpixels/s\n", amounts[k], legacy/1e6, tables/1e6);
+  }
+  return mismatches;
+}
+
+
+// MARK: ===== premultiplied alpha benchmark
+
+static void renderStraightOutput(ViewPtr aView, int aSizeX, int aSizeY)
+{
+  std::vector<PixelColor> row(aSizeX);
+  for (int y=0; y<aSizeY; y++) {
+    aView->rowColorsAt(0, y, aSizeX, &row[0]);
+    alphaDimPixels(&row[0], aSizeX); // LED output needs colors reduced by alpha
+    pixelSum += row[0].r;
+  }
+}
+
+
+static void renderPremultipliedOutput(ViewPtr aView, int aSizeX, int aSizeY)
+{
+  std::vector<PremultPixelColor> row(aSizeX);
+  for (int y=0; y<aSizeY; y++) {
+    aView->premultipliedRowColorsAt(0, y, aSizeX, &row[0]);
+    pixelSum += row[0].r;
+  }
+}
+
+
+static void premultipliedBenchmark()
+{
+  const int sizeX = 72;
+  const int sizeY = 7;
+  // 3 layers of semi-transparent text on a background
+  ViewStackPtr stack = ViewStackPtr(new ViewStack);
+  stack->setFrame(0, 0, sizeX, sizeY);
+  stack->setFullFrameContent();
+  stack->setBackGroundColor(webColorToPixel("203040"));
+  for (int l=0; l<3; l++) {
+    TextViewPtr t = TextViewPtr(new TextView);
+    t->setFrame(0, 0, sizeX, sizeY);
+    t->setText("Premultiplied alpha +++ ");
+    t->setWrapMode(View::wrapX);
+    t->setContentOffset(l*7, 0);
+    PixelColor c = webColorToPixel(l==0 ? "FF0000" : (l==1 ? "00FF00" : "0000FF"));
+    c.a = 100+l*50;
+    t->setTextColor(c);
+    stack->pushView(t);
+  }
+  double straight = pixelsPerSecond(boost::bind(&renderStraightOutput, stack, sizeX, sizeY), sizeX*sizeY);
+  double premultiplied = pixelsPerSecond(boost::bind(&renderPremultipliedOutput, stack, sizeX, sizeY), sizeX*sizeY);
+  printf("3 layer stack to LED output, Mpixels/s: straight alpha %.2f, premultiplied alpha %.2f\n", straight/1e6, premultiplied/1e6);
+}
+
+
+// MARK: ===== scene benchmarks
+
+#define BENCH_PNG_SIZE 512 // width and height of the generated test image
+
+/// a scene to render, optionally scrolled by a fixed step per frame
+typedef struct {
+  const char *name;
+  ViewPtr view; ///< the view to render
+  ViewScrollerPtr scroller; ///< if set, advanced by stepX/stepY before each frame
+  double stepX;
+  double stepY;
+} BenchScene;
+
+
+/// generate a PNG test image with colors and alpha varying over the entire image
+/// @return path of the image file, empty if none could be written
+static string createTestImage()
+{
+  string path = string_format("/tmp/lethd-bench-%d.png", (int)getpid());
+  std::vector<uint8_t> buffer(BENCH_PNG_SIZE*BENCH_PNG_SIZE*4);
+  for (int y=0; y<BENCH_PNG_SIZE; y++) {
+    for (int x=0; x<BENCH_PNG_SIZE; x++) {
+      uint8_t *pix = &buffer[(y*BENCH_PNG_SIZE+x)*4];
+      pix[0] = x;
+      pix[1] = y;
+      pix[2] = x^y;
+      pix[3] = (x+y)&0x80 ? 255 : (x*y)&0xFF;
+    }
+  }
+  png_image img;
+  memset(&img, 0, sizeof(img));
+  img.version = PNG_IMAGE_VERSION;
+  img.width = BENCH_PNG_SIZE;
+  img.height = BENCH_PNG_SIZE;
+  img.format = PNG_FORMAT_RGBA;
+  if (png_image_write_to_file(&img, path.c_str(), 0, &buffer[0], 0, NULL)==0) {
+    printf("Cannot write test image %s: %s\n", path.c_str(), img.message);
+    return "";
+  }
+  return path;
+}
+
+
+static TextViewPtr benchText(const char *aText, PixelColor aColor)
+{
+  TextViewPtr t = TextViewPtr(new TextView);
+  t->setFrame(0, 0, 2000, 7);
+  t->setText(aText);
+  t->setTextColor(aColor);
+  t->setBackGroundColor(transparent);
+  t->setWrapMode(View::wrapX);
+  return t;
+}
+
+
+static ViewScrollerPtr benchScroller(ViewPtr aScrolledView, int aSizeX, int aSizeY)
+{
+  ViewScrollerPtr sc = ViewScrollerPtr(new ViewScroller);
+  sc->setFrame(0, 0, aSizeX, aSizeY);
+  sc->setFullFrameContent();
+  sc->setBackGroundColor(black);
+  sc->setScrolledView(aScrolledView);
+  return sc;
+}
+
+
+static ViewStackPtr benchStack(int aSizeX, int aSizeY)
+{
+  // 3 semi-transparent text layers on a colored background
+  ViewStackPtr stack = ViewStackPtr(new ViewStack);
+  stack->setFrame(0, 0, aSizeX, aSizeY);
+  stack->setFullFrameContent();
+  stack->setBackGroundColor(webColorToPixel("203040"));
+  const char *colors[3] = { "FF0000", "00FF00", "0000FF" };
+  for (int l=0; l<3; l++) {
+    PixelColor c = webColorToPixel(colors[l]);
+    c.a = 100+l*50;
+    TextViewPtr t = benchText("Three layers of text +++ ", c);
+    t->setFrame(0, l*(aSizeY>7 ? (aSizeY-7)/2 : 0), aSizeX, 7);
+    t->setContentOffset(l*7, 0);
+    stack->pushView(t);
+  }
+  return stack;
+}
+
+
+static ViewStackPtr benchOverlays(int aSizeX, int aSizeY)
+{
+  // many small indicator overlays on top of a text layer
+  ViewStackPtr stack = ViewStackPtr(new ViewStack);
+  stack->setFrame(0, 0, aSizeX, aSizeY);
+  stack->setFullFrameContent();
+  stack->setBackGroundColor(black);
+  stack->pushView(benchText("Text behind overlays +++ ", webColorToPixel("FF8000")));
+  const int numOverlays = 32;
+  for (int i=0; i<numOverlays; i++) {
+    PixelColor c = webColorToPixel(i&1 ? "00FFFF" : "FF00FF");
+    c.a = 200;
+    TextViewPtr t = TextViewPtr(new TextView);
+    t->setFrame((i*(aSizeX-5))/numOverlays, aSizeY>7 ? (i*7)%(aSizeY-6) : 0, 5, 7);
+    t->setText(i&1 ? "o" : "+");
+    t->setTextColor(c);
+    t->setBackGroundColor(transparent);
+    t->setWrapMode(View::clipXY);
+    stack->pushView(t);
+  }
+  return stack;
+}
+
+
+static std::vector<BenchScene> benchScenes(int aSizeX, int aSizeY, const string aImagePath)
+{
+  std::vector<BenchScene> scenes;
+  BenchScene sc;
+  const PixelColor textColor = webColorToPixel("FF8000");
+  // scrolling text, as on the display panels
+  sc.name = "text integer";
+  sc.view = sc.scroller = benchScroller(benchText("Scrolling text at integer offsets +++ ", textColor), aSizeX, aSizeY);
+  sc.stepX = 1; sc.stepY = 0;
+  scenes.push_back(sc);
+  sc.name = "text 0.25";
+  sc.view = sc.scroller = benchScroller(benchText("Scrolling text at fractional offsets +++ ", textColor), aSizeX, aSizeY);
+  sc.stepX = 0.25; sc.stepY = 0;
+  scenes.push_back(sc);
+  sc.name = "text 0.25/0.5";
+  sc.view = sc.scroller = benchScroller(benchText("Scrolling text at fractional X and Y +++ ", textColor), aSizeX, aSizeY);
+  sc.scroller->setOffsetY(0.5);
+  sc.stepX = 0.25; sc.stepY = 0;
+  scenes.push_back(sc);
+  // three layers
+  sc.name = "3 layers";
+  sc.view = benchStack(aSizeX, aSizeY);
+  sc.scroller.reset();
+  sc.stepX = 0; sc.stepY = 0;
+  scenes.push_back(sc);
+  sc.name = "3 layers 0.25";
+  sc.view = sc.scroller = benchScroller(benchStack(aSizeX, aSizeY), aSizeX, aSizeY);
+  sc.stepX = 0.25; sc.stepY = 0;
+  scenes.push_back(sc);
+  // three layers, cached
+  RenderCacheViewPtr cache = RenderCacheViewPtr(new RenderCacheView);
+  cache->setFrame(0, 0, aSizeX, aSizeY);
+  cache->setCachedView(benchStack(aSizeX, aSizeY));
+  sc.name = "3 layers cached";
+  sc.view = cache;
+  sc.scroller.reset();
+  sc.stepX = 0; sc.stepY = 0;
+  scenes.push_back(sc);
+  // many small overlays
+  sc.name = "32 overlays";
+  sc.view = benchOverlays(aSizeX, aSizeY);
+  sc.scroller.reset();
+  sc.stepX = 0; sc.stepY = 0;
+  scenes.push_back(sc);
+  // animator showing text
+  ViewAnimatorPtr an = ViewAnimatorPtr(new ViewAnimator);
+  an->setFrame(0, 0, aSizeX, aSizeY);
+  an->setFullFrameContent();
+  an->pushStep(benchText("Animated text +++ ", textColor), 10*Second);
+  an->startAnimation(true);
+  sc.name = "animator";
+  sc.view = an;
+  sc.scroller.reset();
+  scenes.push_back(sc);
+  // large image
+  if (!aImagePath.empty()) {
+    ImageViewPtr img = ImageViewPtr(new ImageView);
+    if (Error::isOK(img->loadPNG(aImagePath))) {
+      img->setFrame(0, 0, aSizeX, aSizeY);
+      img->setWrapMode(View::wrapXY);
+      sc.name = "png";
+      sc.view = img;
+      sc.scroller.reset();
+      scenes.push_back(sc);
+      img = ImageViewPtr(new ImageView);
+      img->loadPNG(aImagePath);
+      img->setWrapMode(View::wrapXY);
+      sc.name = "png 0.25/0.25";
+      sc.view = sc.scroller = benchScroller(img, aSizeX, aSizeY);
+      sc.stepX = 0.25; sc.stepY = 0.25;
+      scenes.push_back(sc);
+    }
+  }
+  return scenes;
+}
+
+
+static void renderScene(BenchScene &aScene, int aSizeX, int aSizeY, std::vector<PremultPixelColor> &aFrame)
+{
+  if (aScene.scroller) {
+    aScene.scroller->setOffsetX(aScene.scroller->getOffsetX()+aScene.stepX);
+    aScene.scroller->setOffsetY(aScene.scroller->getOffsetY()+aScene.stepY);
+  }
+  // full frame, in the form needed for LED output
+  for (int y=0; y<aSizeY; y++) {
+    aScene.view->premultipliedRowColorsAt(0, y, aSizeX, &aFrame[y*aSizeX]);
+  }
+  aScene.view->updated();
+  pixelSum += aFrame[0].r;
+}
+
+
+static void sceneBenchmark()
+{
+  const int sizes[][2] = {
+    { 72, 7 }, // single panel
+    { 216, 7 }, // three panels
+    { 64, 32 },
+    { 128, 64 }
+  };
+  string imagePath = createTestImage();
+  printf("Scenes: full frame renders (premultiplied, as sent to LEDs)\n");
+  printf("%-16s %-9s %12s %12s %12s\n", "scene", "size", "Mpixels/s", "ns/pixel", "frames/s");
+  for (size_t s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+    int sizeX = sizes[s][0];
+    int sizeY = sizes[s][1];
+    std::vector<BenchScene> scenes = benchScenes(sizeX, sizeY, imagePath);
+    std::vector<PremultPixelColor> frame(sizeX*sizeY);
+    string size = string_format("%dx%d", sizeX, sizeY);
+    for (size_t i=0; i<scenes.size(); i++) {
+      double pps = pixelsPerSecond(boost::bind(&renderScene, boost::ref(scenes[i]), sizeX, sizeY, boost::ref(frame)), sizeX*sizeY);
+      printf("%-16s %-9s %12.2f %12.1f %12.0f\n", scenes[i].name, size.c_str(), pps/1e6, 1e9/pps, pps/(sizeX*sizeY));
+    }
+  }
+  if (!imagePath.empty()) unlink(imagePath.c_str());
+}
+
+
+// MARK: ===== row rendering verification
+
+/// compare rowColorsAt() with colorAt() for every pixel of an area
+/// @return number of pixels that differ
+static int rowColorMismatches(ViewPtr aView, int aX, int aY, int aDx, int aDy)
+{
+  int mismatches = 0;
+  std::vector<PixelColor> row(aDx), ref(aDx);
+  for (int y=aY; y<aY+aDy; y++) {
+    aView->rowColorsAt(aX, y, aDx, &row[0]);
+    for (int i=0; i<aDx; i++) ref[i] = aView->colorAt(aX+i, y);
+    for (int i=0; i<aDx; i++) {
+      if (memcmp(&row[i], &ref[i], sizeof(PixelColor))!=0) mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+
+/// verify that ViewStack row compositing, which only renders the parts of a row each layer can
+/// contribute to, yields exactly the same pixels as compositing pixel by pixel
+/// @return number of mismatching pixels
+static int verifyStackRows()
+{
+  const int sizeX = 40;
+  const int sizeY = 12;
+  int mismatches = 0;
+  for (int o=0; o<8; o++) {
+    ViewStackPtr stack = ViewStackPtr(new ViewStack);
+    stack->setFrame(0, 0, sizeX, sizeY);
+    stack->setFullFrameContent();
+    stack->setBackGroundColor(webColorToPixel("20304080"));
+    // - bottom layer, semi-transparent, partly off frame to the left and top
+    TextViewPtr t = benchText("Bottom +++ ", webColorToPixel("FF000090"));
+    t->setFrame(-10, -3, 30, 7);
+    stack->pushView(t);
+    // - opaque layer (stack with clipped content), partly off frame to the right and bottom
+    ViewStackPtr opaque = ViewStackPtr(new ViewStack);
+    opaque->setFrame(25, 7, 30, 7);
+    opaque->setFullFrameContent();
+    opaque->setWrapMode(View::clipXY);
+    opaque->setBackGroundColor(webColorToPixel("004000"));
+    opaque->pushView(benchText("Opaque", webColorToPixel("FFFF00")));
+    // - layer entirely behind the opaque layer, must not show
+    TextViewPtr hidden = benchText("Hidden", webColorToPixel("FFFFFF"));
+    hidden->setFrame(27, 8, 20, 5);
+    hidden->setWrapMode(View::clipXY);
+    stack->pushView(hidden);
+    stack->pushView(opaque);
+    // - semi-transparent layer with layer alpha, overlapping the opaque layer, partly off frame at the top
+    t = benchText("Top layer +++ ", webColorToPixel("00FFFF"));
+    t->setFrame(15, -2, 30, 7);
+    t->setAlpha(150);
+    stack->pushView(t);
+    // - opaque colored text on transparent background, off frame at the bottom left
+    t = benchText("Edge", webColorToPixel("FF00FF"));
+    t->setFrame(-3, 9, 12, 7);
+    t->setWrapMode(View::clipXY);
+    stack->pushView(t);
+    stack->setOrientation(o);
+    // include pixels outside the stack's frame
+    mismatches += rowColorMismatches(stack, -5, -3, sizeX+10, sizeY+6);
+    // move layers and compare again
+    opaque->setFrame(10+o, 2, 30, 7);
+    hidden->setFrame(12+o, 3, 20, 5);
+    stack->step();
+    mismatches += rowColorMismatches(stack, -5, -3, sizeX+10, sizeY+6);
+  }
+  printf("View stack rows: %s\n", mismatches==0 ? "results identical to pixel by pixel compositing" : "MISMATCHES FOUND");
+  return mismatches;
+}
+
+
+/// verify that ViewScroller subpixel scrolling from prerendered samples yields exactly the same pixels
+/// as sampling the scrolled view directly, for rows as well as single pixels
+/// @return number of mismatching pixels
+static int verifyScrollerRows()
+{
+  const int sizeX = 40;
+  const int sizeY = 9;
+  const double offsets[][2] = {
+    { 0.25, 0 }, { 0.75, 0 }, { 0, 0.5 }, { 0.25, 0.5 }, { -0.25, 0.75 }, { 1234.6, -2.3 }, { -37.5, 3.25 }
+  };
+  int mismatches = 0;
+  for (int c=0; c<2; c++) {
+    ViewPtr content = c==0 ?
+      ViewPtr(benchText("Scrolled text +++ ", webColorToPixel("FF800080"))) :
+      ViewPtr(benchStack(sizeX, sizeY));
+    content->setWrapMode(View::wrapX);
+    ViewScrollerPtr scroller = benchScroller(content, sizeX, sizeY);
+    // reference: without a visible window, no samples are prerendered, so all pixels are sampled directly
+    ViewScrollerPtr reference = benchScroller(content, 0, 0);
+    std::vector<PixelColor> row(sizeX);
+    for (size_t o=0; o<sizeof(offsets)/sizeof(offsets[0]); o++) {
+      scroller->setOffsetX(offsets[o][0]);
+      scroller->setOffsetY(offsets[o][1]);
+      reference->setOffsetX(offsets[o][0]);
+      reference->setOffsetY(offsets[o][1]);
+      for (int y=0; y<sizeY; y++) {
+        scroller->rowColorsAt(0, y, sizeX, &row[0]);
+        for (int x=0; x<sizeX; x++) {
+          PixelColor ref = reference->colorAt(x, y);
+          PixelColor single = scroller->colorAt(x, y);
+          if (memcmp(&row[x], &ref, sizeof(PixelColor))!=0) mismatches++;
+          if (memcmp(&single, &ref, sizeof(PixelColor))!=0) mismatches++;
+        }
+      }
+      scroller->updated();
+    }
+  }
+  printf("View scroller subpixel rows: %s\n", mismatches==0 ? "results identical to direct sampling" : "MISMATCHES FOUND");
+  return mismatches;
+}
+
+
+// MARK: ===== render cache verification
+
+/// view stack counting how often its content is rendered
+class CountingViewStack : public ViewStack
+{
+  typedef ViewStack inherited;
+
+public:
+
+  std::vector<int> rowRenders; ///< number of times each content row was rendered (partially or entirely)
+  int pixelRenders; ///< number of pixels rendered one by one
+
+  CountingViewStack() : pixelRenders(0) {}
+
+  void resetCounts(int aNumRows) { rowRenders.assign(aNumRows, 0); pixelRenders = 0; }
+
+protected:
+
+  virtual PixelColor contentColorAt(int aX, int aY) P44_OVERRIDE
+  {
+    pixelRenders++;
+    return inherited::contentColorAt(aX, aY);
+  }
+
+  virtual void contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels) P44_OVERRIDE
+  {
+    if (aY>=0 && aY<(int)rowRenders.size()) rowRenders[aY]++;
+    inherited::contentRowColorsAt(aX, aY, aNumPixels, aPixels);
+  }
+
+};
+typedef boost::intrusive_ptr<CountingViewStack> CountingViewStackPtr;
+
+
+/// stack of text layers for verifying the render cache
+static ViewStackPtr cacheTestStack(int aSizeX, int aSizeY, std::vector<TextViewPtr> &aLayers, ViewStackPtr aStack = ViewStackPtr())
+{
+  ViewStackPtr stack = aStack ? aStack : ViewStackPtr(new ViewStack);
+  stack->setFrame(0, 0, aSizeX, aSizeY);
+  stack->setFullFrameContent();
+  stack->setBackGroundColor(webColorToPixel("102030"));
+  aLayers.clear();
+  for (int l=0; l<3; l++) {
+    TextViewPtr t = benchText("Cached +++ ", webColorToPixel(l==0 ? "FF000080" : (l==1 ? "00FF00" : "0000FFC0")));
+    t->setFrame(l*5, l*4, aSizeX/2, 7);
+    stack->pushView(t);
+    aLayers.push_back(t);
+  }
+  return stack;
+}
+
+
+/// change the layers of a cache test stack
+static void changeCacheTestLayers(std::vector<TextViewPtr> &aLayers, int aFrame)
+{
+  TextViewPtr t = aLayers[aFrame%aLayers.size()];
+  switch (aFrame%4) {
+    case 0: t->setContentOffset(aFrame, 0); break;
+    case 1: t->setTextColor(webColorToPixel(aFrame&0x2 ? "FFFF00" : "FF00FF60")); break;
+    case 2: t->setFrame(aFrame%11, aFrame%9, 20+aFrame%30, 7); break;
+    default: break; // no change
+  }
+}
+
+
+/// verify that a RenderCacheView always shows the same as rendering its cached view directly,
+/// and renders each changed row of the cached view exactly once
+/// @return number of mismatching frames plus number of frames with missing or repeated rendering
+/// @note the cache is a layer in a parent stack, and frames are rendered with and without stepping
+///   the parent first, with updated() called before rendering, and read per pixel rather than by
+///   rows, to check that no call order makes the cache serve outdated pixels or render more than needed
+static int verifyRenderCache()
+{
+  const int sizeX = 64;
+  const int sizeY = 16;
+  std::vector<TextViewPtr> directLayers, cachedLayers;
+  ViewStackPtr direct = ViewStackPtr(new ViewStack);
+  direct->setFrame(0, 0, sizeX, sizeY);
+  direct->setFullFrameContent();
+  direct->pushView(cacheTestStack(sizeX, sizeY, directLayers));
+  RenderCacheViewPtr cache = RenderCacheViewPtr(new RenderCacheView);
+  cache->setFrame(0, 0, sizeX, sizeY);
+  CountingViewStackPtr counted = CountingViewStackPtr(new CountingViewStack);
+  cache->setCachedView(cacheTestStack(sizeX, sizeY, cachedLayers, counted));
+  ViewStackPtr cached = ViewStackPtr(new ViewStack);
+  cached->setFrame(0, 0, sizeX, sizeY);
+  cached->setFullFrameContent();
+  cached->pushView(cache);
+  std::vector<PixelColor> row(sizeX), ref(sizeX);
+  PixelRect cacheArea = { .x=0, .y=0, .dx=sizeX, .dy=sizeY };
+  int mismatches = 0;
+  int renderErrors = 0;
+  for (int f=0; f<200; f++) {
+    changeCacheTestLayers(directLayers, f);
+    changeCacheTestLayers(cachedLayers, f);
+    int order = (f/4)%4;
+    if (order==0 || order==3) {
+      // normal order: step, render, updated
+      direct->step();
+      cached->step();
+    }
+    // area of the cached view that must be rendered in this frame (all of it for the first frame)
+    PixelRect damage = f==0 ? cacheArea : intersectRect(counted->dirtyRect(), cacheArea);
+    counted->resetCounts(sizeY);
+    if (order==2) {
+      // updated before rendering
+      direct->updated();
+      cached->updated();
+    }
+    bool same = true;
+    for (int y=0; y<sizeY; y++) {
+      direct->rowColorsAt(0, y, sizeX, &ref[0]);
+      if (order==3) {
+        // per pixel
+        for (int x=0; x<sizeX; x++) row[x] = cached->colorAt(x, y);
+      }
+      else {
+        cached->rowColorsAt(0, y, sizeX, &row[0]);
+      }
+      if (!samePixels(row, ref)) same = false;
+    }
+    if (!same) mismatches++;
+    if (order!=2) {
+      direct->updated();
+      cached->updated();
+    }
+    // each damaged row must have been rendered once, all others not at all
+    bool once = counted->pixelRenders==0;
+    for (int y=0; y<sizeY; y++) {
+      if (counted->rowRenders[y]!=(y>=damage.y && y<damage.y+damage.dy ? 1 : 0)) once = false;
+    }
+    if (!once) renderErrors++;
+  }
+  printf("Render cache: %s\n", mismatches==0 ? "results identical to direct rendering" : "MISMATCHES FOUND");
+  printf("Render cache: %s\n", renderErrors==0 ? "changed rows rendered exactly once" : "ROWS RENDERED MISSING OR REPEATEDLY");
+  return mismatches+renderErrors;
+}
+
+
+// MARK: ===== LED output
+
+static void outputFrame(LEDOutputPtr aOutput, const std::vector<PremultPixelColor> &aFrame, int aSizeX, int aSizeY)
+{
+  for (int y=0; y<aSizeY; y++) {
+    const PremultPixelColor *p = &aFrame[y*aSizeX];
+    for (int x=0; x<aSizeX; x++) {
+      aOutput->setColorXY(x, y, p[x].r, p[x].g, p[x].b);
+    }
+  }
+  aOutput->show();
+}
+
+
+static void outputFrameRows(LEDOutputPtr aOutput, const std::vector<PremultPixelColor> &aFrame, int aSizeX, int aSizeY)
+{
+  // same as DispPanel::present()
+  std::vector<uint8_t> rgb(3*aSizeX);
+  for (int y=0; y<aSizeY; y++) {
+    const PremultPixelColor *p = &aFrame[y*aSizeX];
+    uint8_t *c = &rgb[0];
+    for (int x=0; x<aSizeX; x++, c+=3) {
+      c[0] = p[x].r;
+      c[1] = p[x].g;
+      c[2] = p[x].b;
+    }
+    aOutput->setRowColorsXY(0, y, aSizeX, &rgb[0]);
+  }
+  aOutput->show();
+}
+
+
+static void outputFrameMapped(LEDOutputPtr aOutput, LEDMappingPtr aMapping, std::vector<uint8_t> &aLedColors, const std::vector<PremultPixelColor> &aFrame)
+{
+  // same as DispPanel::present()
+  aMapping->mapCanvas((const uint8_t *)&aFrame[0], sizeof(PremultPixelColor), &aLedColors[0]);
+  aOutput->setColors(0, aMapping->getNumLeds(), &aLedColors[0]);
+  aOutput->show();
+}
+
+
+/// @return number of LEDs not showing the color of the frame pixel they are wired to
+static int outputMappingErrors(MemoryLEDOutputPtr aOutput, const std::vector<PremultPixelColor> &aFrame, int aSizeX, int aSizeY)
+{
+  // same wiring as a display panel: serpentine rows
+  int errors = 0;
+  const uint8_t *shown = aOutput->getShownPixels();
+  for (int y=0; y<aSizeY; y++) {
+    for (int x=0; x<aSizeX; x++) {
+      int led = y*aSizeX + ((y & 1) ? aSizeX-1-x : x);
+      const PremultPixelColor &p = aFrame[y*aSizeX+x];
+      if (shown[led*3]!=p.r || shown[led*3+1]!=p.g || shown[led*3+2]!=p.b) errors++;
+    }
+  }
+  return errors;
+}
+
+
+static int outputBenchmark()
+{
+  const int sizeX = 74;
+  const int sizeY = 7;
+  std::vector<PremultPixelColor> frame(sizeX*sizeY);
+  for (size_t i=0; i<frame.size(); i++) frame[i] = premultipliedPixel(randomPixel());
+  MemoryLEDOutputPtr output = MemoryLEDOutputPtr(new MemoryLEDOutput(sizeX*sizeY, sizeX, false, true));
+  output->begin();
+  // per LED
+  outputFrame(output, frame, sizeX, sizeY);
+  int errors = outputMappingErrors(output, frame, sizeX, sizeY);
+  double pps = pixelsPerSecond(boost::bind(&outputFrame, output, boost::ref(frame), sizeX, sizeY), sizeX*sizeY);
+  printf("LED output: %dx%d frame to memory output per LED: %.2f Mpixels/s, %.1f ns/pixel%s\n", sizeX, sizeY, pps/1e6, 1e9/pps, errors ? " - MAPPING MISMATCH!" : "");
+  // per row
+  output->clear();
+  output->show();
+  outputFrameRows(output, frame, sizeX, sizeY);
+  int rowErrors = outputMappingErrors(output, frame, sizeX, sizeY);
+  pps = pixelsPerSecond(boost::bind(&outputFrameRows, output, boost::ref(frame), sizeX, sizeY), sizeX*sizeY);
+  printf("LED output: %dx%d frame to memory output per row:  %.2f Mpixels/s, %.1f ns/pixel%s\n", sizeX, sizeY, pps/1e6, 1e9/pps, rowErrors ? " - MAPPING MISMATCH!" : "");
+  // per frame via mapping table
+  LEDMappingPtr mapping = LEDMappingPtr(new LEDMapping(sizeX, sizeY));
+  mapping->addModule(0, 0, sizeX, sizeY, LEDMapping::serpentine);
+  std::vector<uint8_t> ledColors(3*mapping->getNumLeds());
+  output->clear();
+  output->show();
+  outputFrameMapped(output, mapping, ledColors, frame);
+  int mapErrors = outputMappingErrors(output, frame, sizeX, sizeY);
+  pps = pixelsPerSecond(boost::bind(&outputFrameMapped, output, mapping, boost::ref(ledColors), boost::ref(frame)), sizeX*sizeY);
+  printf("LED output: %dx%d frame to memory output by mapping: %.2f Mpixels/s, %.1f ns/pixel%s\n", sizeX, sizeY, pps/1e6, 1e9/pps, mapErrors ? " - MAPPING MISMATCH!" : "");
+  return errors+rowErrors+mapErrors>0 ? 1 : 0;
+}
+
+
+static void calibrateFrame(const LEDCalibration &aCalibration, const std::vector<uint8_t> &aColors, std::vector<uint8_t> &aCalibrated)
+{
+  aCalibration.apply(&aColors[0], &aCalibrated[0], (int)aColors.size()/3);
+}
+
+
+static int calibrationBenchmark()
+{
+  const int numLeds = 74*7;
+  std::vector<uint8_t> colors(3*numLeds);
+  std::vector<uint8_t> calibrated(3*numLeds);
+  for (size_t i=0; i<colors.size(); i++) colors[i] = rand() & 0xFF;
+  int errors = 0;
+  // default calibration must not change anything
+  LEDCalibration cal;
+  calibrateFrame(cal, colors, calibrated);
+  if (!cal.isIdentity() || calibrated!=colors) errors++;
+  // brightness and white balance scale, gamma keeps black and full
+  cal.setBrightness(128);
+  cal.setWhiteBalance(1, 0.5, 1);
+  cal.setGamma(2.2);
+  uint8_t probe[6] = { 255, 255, 255, 0, 0, 0 };
+  cal.apply(probe, probe, 2);
+  if (probe[0]!=128 || probe[1]!=64 || probe[2]!=128 || probe[3]!=0 || probe[4]!=0 || probe[5]!=0) errors++;
+  double pps = pixelsPerSecond(boost::bind(&calibrateFrame, boost::ref(cal), boost::ref(colors), boost::ref(calibrated)), numLeds);
+  printf("LED calibration: gamma, white balance and brightness for %d LEDs: %.2f Mpixels/s, %.1f ns/pixel%s\n", numLeds, pps/1e6, 1e9/pps, errors ? " - CALIBRATION MISMATCH!" : "");
+  return errors>0 ? 1 : 0;
+}
+
+
+// MARK: ===== capture comparison
+
+/// get next frame of a channel which differs from the previous frame of that channel
+static bool nextChangedFrame(FrameCaptureReaderPtr aReader, int aChannel, CapturedFrame &aFrame, ErrorPtr &aError)
+{
+  std::vector<uint8_t> previous;
+  previous.swap(aFrame.pixels);
+  while (aReader->readFrame(aFrame, aError)) {
+    if (aFrame.channel==aChannel && aFrame.pixels!=previous) return true;
+  }
+  return false;
+}
+
+
+/// compare the output of two frame captures, e.g. before and after an optimisation
+/// @return number of channels with different output, -1 on error
+/// @note frames repeated unchanged (e.g. refreshes) are ignored, so only the sequence of different
+///   frames sent to each chain is compared, not the timing
+static int compareCaptures(const string aCapture1, const string aCapture2)
+{
+  int differences = 0;
+  for (int ch=0; ; ch++) {
+    FrameCaptureReaderPtr r1 = FrameCaptureReaderPtr(new FrameCaptureReader);
+    FrameCaptureReaderPtr r2 = FrameCaptureReaderPtr(new FrameCaptureReader);
+    ErrorPtr err = r1->open(aCapture1);
+    if (Error::isOK(err)) err = r2->open(aCapture2);
+    if (!Error::isOK(err)) {
+      printf("Error: %s\n", err->description().c_str());
+      return -1;
+    }
+    CapturedFrame f1, f2;
+    ErrorPtr err1, err2;
+    long frames = 0;
+    long firstDiff = -1;
+    long diffFrames = 0;
+    bool more1, more2;
+    while (true) {
+      more1 = nextChangedFrame(r1, ch, f1, err1);
+      more2 = nextChangedFrame(r2, ch, f2, err2);
+      if (!more1 || !more2) break;
+      if (f1.pixels!=f2.pixels) {
+        if (firstDiff<0) firstDiff = frames;
+        diffFrames++;
+      }
+      frames++;
+    }
+    if (!Error::isOK(err1) || !Error::isOK(err2)) {
+      printf("Error: %s\n", (Error::isOK(err1) ? err2 : err1)->description().c_str());
+      return -1;
+    }
+    if (ch>=r1->numChannels() && ch>=r2->numChannels()) break; // no more channels
+    printf("channel %d (%s): %ld changed frames compared, %ld different", ch, ch<r1->numChannels() ? r1->channel(ch).outputSpec.c_str() : r2->channel(ch).outputSpec.c_str(), frames, diffFrames);
+    if (firstDiff>=0) printf(", first difference at changed frame #%ld", firstDiff);
+    if (more1 || more2) printf(", %s has more frames", more1 ? aCapture1.c_str() : aCapture2.c_str());
+    printf("\n");
+    if (diffFrames>0 || more1 || more2) differences++;
+  }
+  printf(differences ? "Captures differ\n" : "Captures show identical output\n");
+  return differences;
+}
+
+
+// MARK: ===== main
+
+int main(int argc, char **argv)
+{
+  string what = argc>1 ? argv[1] : "";
+  if (what=="compare") {
+    if (argc!=4) {
+      printf("Usage: %s compare <capturefile1> <capturefile2>\n", argv[0]);
+      return 1;
+    }
+    int differences = compareCaptures(argv[2], argv[3]);
+    return differences<0 ? 1 : (differences>0 ? 2 : 0);
+  }
+  int errors = 0;
+  if (what.empty() || what=="scenes") {
+    sceneBenchmark();
+  }
+  if (what.empty() || what=="components") {
+    orientationBenchmark();
+    errors += kernelBenchmark();
+    errors += mixingBenchmark();
+    premultipliedBenchmark();
+    errors += verifyStackRows();
+    errors += verifyScrollerRows();
+    errors += verifyRenderCache();
+    errors += outputBenchmark();
+    errors += calibrationBenchmark();
+  }
+  if (errors>0) return 2;
+  return pixelSum==0 ? 1 : 0; // use pixelSum
+}
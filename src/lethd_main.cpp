@@ -23,7 +23,9 @@
 #include "digitalio.hpp"
 #include "analogio.hpp"
 #include "jsoncomm.hpp"
-#include "ledchaincomm.hpp"
+#include "ledoutput.hpp"
+#include "framecapture.hpp"
+#include "framereplay.hpp"
 
 #include "lethdapi.hpp"
 
@@ -31,6 +33,8 @@
 #include "neuron.hpp"
 #include "dispmatrix.hpp"
 
+#include <signal.h>
+
 
 using namespace p44;
 
@@ -99,6 +103,8 @@ class LEthD : public CmdLineApp
 
   LethdApiPtr lethdApi;
 
+  FrameReplayPtr replay;
+
 
 public:
 
@@ -114,13 +120,21 @@ public:
       { 0  , "pwmdimmer",      true,  "pinspec;PWM dimmer output pin" },
       { 0  , "sensor0",        true,  "pinspec;analog sensor0 input to use" },
       { 0  , "sensor1",        true,  "pinspec;analog sensor1 input to use" },
-      { 0  , "ledchain1",      true,  "devicepath;ledchain1 device to use" },
-      { 0  , "ledchain2",      true,  "devicepath;ledchain2 device to use" },
-      { 0  , "ledchain3",      true,  "devicepath;ledchain3 device to use" },
+      { 0  , "ledchain1",      true,  "output;ledchain1 device path, 'memory' or 'file:<path>' for raw frames" },
+      { 0  , "ledchain2",      true,  "output;ledchain2 device path, 'memory' or 'file:<path>' for raw frames" },
+      { 0  , "ledchain3",      true,  "output;ledchain3 device path, 'memory' or 'file:<path>' for raw frames" },
       { 0  , "lethdapiport",   true,  "port;server port number for lETHd JSON API (default=none)" },
       { 0  , "neuron",         true,  "mvgAvgCnt,threshold,nAxonLeds,nBodyLeds;start neuron" },
       { 0  , "light",          false, "start light" },
       { 0  , "dispmatrix",     true,  "numcols;start display matrix" },
+      { 0  , "renderthreads",  true,  "numthreads;worker threads to render display panels in parallel (default=0: render on main thread)" },
+      { 0  , "renderthread",   false, "step, render and output display panels on a separate thread" },
+      { 0  , "refreshinterval", true, "ms;interval for refreshing unchanged display panels to clean away glitches (default=100, 0=never)" },
+      { 0  , "powerbudget",    true,  "mA;max current for the LEDs of all display panels, brightness is reduced automatically to stay within (default=0: no limit)" },
+      { 0  , "capture",        true,  "capturefile;record all frames sent to LED outputs into capturefile" },
+      { 0  , "replay",         true,  "capturefile;replay frames from capturefile to LED outputs, then exit" },
+      { 0  , "replayto",       true,  "output;replay to this output instead of the recorded ones (e.g. 'memory')" },
+      { 0  , "replaymaxspeed", false, "replay as fast as possible rather than with original timing" },
       { 0  , "jsonapiport",    true,  "port;server port number for JSON API (default=none)" },
       { 0  , "jsonapinonlocal",false, "allow JSON API from non-local clients" },
       { 0  , "jsonapiipv6",    false, "JSON API on IPv6" },
@@ -158,6 +172,25 @@ public:
       SETERRLEVEL(errlevel, !getOption("dontlogerrors"));
       SETDELTATIME(getOption("deltatstamps"));
 
+      // capture output frames
+      string path;
+      if (getStringOption("capture", path)) {
+        ErrorPtr err = FrameCapture::startCapture(path);
+        if (!Error::isOK(err)) {
+          LOG(LOG_ERR, "Cannot capture frames: %s", err->description().c_str());
+        }
+      }
+      // replay captured frames
+      if (getStringOption("replay", path)) {
+        replay = FrameReplayPtr(new FrameReplay(getOption("replayto", ""), getOption("replaymaxspeed")!=NULL));
+        ErrorPtr err = replay->start(path, boost::bind(&LEthD::replayDone, this));
+        if (!Error::isOK(err)) {
+          LOG(LOG_ERR, "Cannot replay frames: %s", err->description().c_str());
+          terminateApp(EXIT_FAILURE);
+        }
+        return run();
+      }
+
       // create button input
       button = ButtonInputPtr(new ButtonInput(getOption("button","missing")));
       button->setButtonHandler(boost::bind(&LEthD::buttonHandler, this, _1, _2, _3), true, Second);
@@ -217,6 +250,12 @@ public:
   }
 
 
+  void replayDone()
+  {
+    terminateApp(EXIT_SUCCESS);
+  }
+
+
   void neuronSpike(double aValue) {
     lethdApi->send(aValue);
   }
@@ -383,6 +422,8 @@ int main(int argc, char **argv)
   // prevent debug output before application.main scans command line
   SETLOGLEVEL(LOG_EMERG);
   SETERRLEVEL(LOG_EMERG, false); // messages, if any, go to stderr
+  // a reader of a FIFO output (see FileLEDOutput) going away must not terminate the daemon
+  signal(SIGPIPE, SIG_IGN);
   // create app with current mainloop
   static LEthD application;
   // pass control
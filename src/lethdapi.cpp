@@ -153,6 +153,9 @@ ErrorPtr LethdApi::processRequest(ApiRequestPtr aRequest)
     else if (cmd=="status") {
       return status(aRequest);
     }
+    else if (cmd=="stats") {
+      return stats(aRequest);
+    }
     else if (cmd=="ping") {
       return ping(aRequest);
     }
@@ -240,6 +243,29 @@ ErrorPtr LethdApi::status(ApiRequestPtr aRequest)
 }
 
 
+ErrorPtr LethdApi::stats(ApiRequestPtr aRequest)
+{
+  JsonObjectPtr o;
+  bool reset = false;
+  if (aRequest->getRequest()->get("reset", o, true)) {
+    reset = o->boolValue();
+  }
+  JsonObjectPtr answer = JsonObject::newObj();
+  // - statistics of features that have any
+  JsonObjectPtr features = JsonObject::newObj();
+  for (FeatureMap::iterator f = featureMap.begin(); f!=featureMap.end(); ++f) {
+    if (!f->second->isInitialized()) continue;
+    JsonObjectPtr s = f->second->stats(reset);
+    if (s) features->add(f->first.c_str(), s);
+  }
+  answer->add("features", features);
+  answer->add("now", JsonObject::newInt64(MainLoop::unixtime()/MilliSecond));
+  // - return
+  aRequest->sendResponse(answer, ErrorPtr());
+  return ErrorPtr();
+}
+
+
 ErrorPtr LethdApi::ping(ApiRequestPtr aRequest)
 {
   JsonObjectPtr answer = JsonObject::newObj();
@@ -122,6 +122,7 @@ namespace p44 {
     ErrorPtr reset(ApiRequestPtr aRequest);
     ErrorPtr now(ApiRequestPtr aRequest);
     ErrorPtr status(ApiRequestPtr aRequest);
+    ErrorPtr stats(ApiRequestPtr aRequest);
     ErrorPtr ping(ApiRequestPtr aRequest);
     ErrorPtr features(ApiRequestPtr aRequest);
 
@@ -119,8 +119,8 @@ ErrorPtr Neuron::fire(ApiRequestPtr aRequest)
 void Neuron::initOperation()
 {
   LOG(LOG_NOTICE, "initializing neuron");
-  ledChain1 = LEDChainCommPtr(new LEDChainComm(LEDChainComm::ledtype_ws281x, ledChain1Name, 100));
-  ledChain2 = LEDChainCommPtr(new LEDChainComm(LEDChainComm::ledtype_ws281x, ledChain2Name, 100));
+  ledChain1 = LEDOutput::newOutput(ledChain1Name, 100);
+  ledChain2 = LEDOutput::newOutput(ledChain2Name, 100);
   ledChain1->begin();
   ledChain1->show();
   ledChain2->begin();
@@ -23,7 +23,7 @@
 #define __lethd_neuron_hpp__
 
 #include "analogio.hpp"
-#include "ledchaincomm.hpp"
+#include "ledoutput.hpp"
 
 #include "feature.hpp"
 
@@ -38,9 +38,9 @@ namespace p44 {
     typedef Feature inherited;
 
     string ledChain1Name;
-    LEDChainCommPtr ledChain1;
+    LEDOutputPtr ledChain1;
     string ledChain2Name;
-    LEDChainCommPtr ledChain2;
+    LEDOutputPtr ledChain2;
     AnalogIoPtr sensor;
 
     NeuronSpikeCB neuronSpike;
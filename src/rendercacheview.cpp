@@ -0,0 +1,198 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "rendercacheview.hpp"
+
+using namespace p44;
+
+
+// MARK: ===== RenderCacheView
+
+
+RenderCacheView::RenderCacheView() :
+  cacheSizeX(0),
+  cacheSizeY(0),
+  cacheValid(false),
+  cacheDamage(zeroRect),
+  damageCollected(false),
+  collectedDamage(zeroRect)
+{
+}
+
+
+RenderCacheView::~RenderCacheView()
+{
+}
+
+
+void RenderCacheView::setCachedView(ViewPtr aCachedView)
+{
+  cachedView = aCachedView;
+  if (contentSizeX==0 && contentSizeY==0) {
+    setFullFrameContent();
+  }
+  invalidate();
+}
+
+
+void RenderCacheView::setFrame(int aOriginX, int aOriginY, int aSizeX, int aSizeY)
+{
+  inherited::setFrame(aOriginX, aOriginY, aSizeX, aSizeY);
+  cacheValid = false;
+}
+
+
+void RenderCacheView::clear()
+{
+  cachedView.reset();
+  cache.clear();
+  cacheValid = false;
+  inherited::clear();
+}
+
+
+MLMicroSeconds RenderCacheView::step()
+{
+  MLMicroSeconds nextCall = inherited::step();
+  if (cachedView) {
+    MLMicroSeconds n = cachedView->step();
+    if (nextCall<0 || (n>0 && n<nextCall)) {
+      nextCall = n;
+    }
+    // stepping may have changed the cached view again
+    damageCollected = false;
+  }
+  return nextCall;
+}
+
+
+void RenderCacheView::collectDamage()
+{
+  if (damageCollected || !cachedView) return; // already done for this frame
+  damageCollected = true;
+  collectedDamage = zeroRect;
+  if (cachedView->isDirty()) {
+    // cached view has changed, changed area must be re-rendered
+    collectedDamage = cachedView->dirtyRect();
+    cacheDamage = unionRect(cacheDamage, collectedDamage);
+  }
+}
+
+
+bool RenderCacheView::isDirty()
+{
+  if (cachedView && cachedView->isDirty()) return true;
+  return inherited::isDirty();
+}
+
+
+PixelRect RenderCacheView::dirtyRect()
+{
+  PixelRect r = inherited::dirtyRect();
+  if (cachedView) {
+    collectDamage();
+    PixelRect d = collectedDamage;
+    PixelRect cacheArea = { .x=0, .y=0, .dx=contentSizeX, .dy=contentSizeY };
+    r = unionRect(r, contentToFrameRect(intersectRect(d, cacheArea)));
+  }
+  return r;
+}
+
+
+void RenderCacheView::updated()
+{
+  inherited::updated();
+  if (cachedView) {
+    // damage must be kept until actually rendered into the cache, updated() might come before that
+    if (!damageCollected) {
+      collectDamage();
+    }
+    else if (cachedView->isDirty()) {
+      // only keep changes made after the damage was collected (and possibly rendered already)
+      PixelRect d = cachedView->dirtyRect();
+      if (d.x!=collectedDamage.x || d.y!=collectedDamage.y || d.dx!=collectedDamage.dx || d.dy!=collectedDamage.dy) {
+        cacheDamage = unionRect(cacheDamage, d);
+      }
+    }
+    cachedView->updated();
+    damageCollected = false;
+  }
+}
+
+
+void RenderCacheView::updateCache()
+{
+  // pick up changes not yet seen via dirtyRect()/updated(), so the cache never serves stale pixels,
+  // regardless of whether and in which order parents call step(), isDirty() and dirtyRect()
+  // Note: this is cheap after the first access in a frame
+  collectDamage();
+  PixelRect r;
+  if (cacheValid && cacheSizeX==contentSizeX && cacheSizeY==contentSizeY) {
+    // cache is valid, only re-render damaged area (if any)
+    if (rectIsEmpty(cacheDamage)) return; // nothing to do
+    PixelRect cacheArea = { .x=0, .y=0, .dx=cacheSizeX, .dy=cacheSizeY };
+    r = intersectRect(cacheDamage, cacheArea);
+  }
+  else {
+    // entire cache must be rendered
+    cacheSizeX = contentSizeX>0 ? contentSizeX : 0;
+    cacheSizeY = contentSizeY>0 ? contentSizeY : 0;
+    if (cacheSizeX==0) cacheSizeY = 0; // nothing to cache
+    cache.resize(cacheSizeX*cacheSizeY);
+    r.x = 0; r.y = 0; r.dx = cacheSizeX; r.dy = cacheSizeY;
+  }
+  for (int y=r.y; y<r.y+r.dy; ++y) {
+    PixelColor *row = &cache[y*cacheSizeX+r.x];
+    if (cachedView) {
+      cachedView->rowColorsAt(r.x, y, r.dx, row);
+    }
+    else {
+      for (int i=0; i<r.dx; ++i) row[i] = transparent;
+    }
+  }
+  cacheDamage = zeroRect;
+  cacheValid = true;
+}
+
+
+PixelColor RenderCacheView::contentColorAt(int aX, int aY)
+{
+  updateCache();
+  if (aX<0 || aY<0 || aX>=cacheSizeX || aY>=cacheSizeY) {
+    return inherited::contentColorAt(aX, aY);
+  }
+  return cache[aY*cacheSizeX+aX];
+}
+
+
+void RenderCacheView::contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels)
+{
+  updateCache();
+  if (aY<0 || aY>=cacheSizeY) {
+    inherited::contentRowColorsAt(aX, aY, aNumPixels, aPixels);
+    return;
+  }
+  const PixelColor *row = &cache[aY*cacheSizeX];
+  for (int i=0; i<aNumPixels; ++i) {
+    int x = aX+i;
+    aPixels[i] = x>=0 && x<cacheSizeX ? row[x] : backgroundColor;
+  }
+}
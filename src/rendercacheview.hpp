@@ -0,0 +1,114 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __pixelboardd_rendercacheview_hpp__
+#define __pixelboardd_rendercacheview_hpp__
+
+#include "view.hpp"
+
+namespace p44 {
+
+  /// View that keeps a rendered copy of another view (and its subviews) and only re-renders
+  /// it when the cached view reports changes via isDirty(). Only the area reported by the cached
+  /// view's dirtyRect() is re-rendered. Changes are picked up once per frame, at rendering time or
+  /// at the latest before the cached view's dirty state is cleared in updated(), so no particular
+  /// step()/isDirty() call order by the parent views is needed.
+  /// @note the cached area is this view's content area. The cached view is sampled at
+  ///   content coordinates 0..contentSizeX-1 / 0..contentSizeY-1 (i.e. in its parent coordinates),
+  ///   anything the cached view might show outside that area is not visible.
+  class RenderCacheView : public View
+  {
+    typedef View inherited;
+
+    ViewPtr cachedView; ///< the view to render into the cache
+    std::vector<PixelColor> cache; ///< rendered pixels, contentSizeX*contentSizeY
+    int cacheSizeX; ///< X size of the currently rendered cache
+    int cacheSizeY; ///< Y size of the currently rendered cache
+    bool cacheValid; ///< set when cache represents the current state of cachedView
+    PixelRect cacheDamage; ///< area of the cache that needs to be re-rendered (in content coordinates)
+    bool damageCollected; ///< set when the cached view's changes have been added to cacheDamage since the last step() or updated()
+    PixelRect collectedDamage; ///< the cached view's dirtyRect() at the time it was added to cacheDamage
+
+  protected:
+
+    /// get content pixel color
+    /// @param aX content X coordinate
+    /// @param aY content Y coordinate
+    /// @note aX and aY are NOT guaranteed to be within actual content as defined by contentSizeX/Y
+    ///   implementation must check this!
+    virtual PixelColor contentColorAt(int aX, int aY) P44_OVERRIDE;
+
+    /// get a horizontal run of content pixel colors
+    virtual void contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels) P44_OVERRIDE;
+
+  public :
+
+    /// create view
+    RenderCacheView();
+
+    virtual ~RenderCacheView();
+
+    /// set the view to be cached
+    /// @param aCachedView the view to render into the cache
+    /// @note sets the content size to the frame size if no content size is set yet
+    void setCachedView(ViewPtr aCachedView);
+
+    /// @return the view being cached
+    ViewPtr getCachedView() { return cachedView; }
+
+    /// force re-rendering the cache at next access
+    void invalidate() { cacheValid = false; makeDirty(); }
+
+    /// set the frame within the parent coordinate system
+    virtual void setFrame(int aOriginX, int aOriginY, int aSizeX, int aSizeY) P44_OVERRIDE;
+
+    /// clear contents of this view
+    virtual void clear() P44_OVERRIDE;
+
+    /// calculate changes on the display, return time of next change
+    /// @return Infinite if there is no immediate need to call step again, otherwise mainloop time of when to call again latest
+    /// @note this must be called as demanded by return value, and after making changes to the view
+    virtual MLMicroSeconds step() P44_OVERRIDE;
+
+    /// return if anything changed on the display since last call
+    virtual bool isDirty() P44_OVERRIDE;
+
+    /// get the area that changed since last call to updated()
+    virtual PixelRect dirtyRect() P44_OVERRIDE;
+
+    /// call when display is updated
+    virtual void updated() P44_OVERRIDE;
+
+  private:
+
+    void updateCache();
+
+    /// add the area the cached view reports as changed to the cache damage, once per frame
+    void collectDamage();
+
+  };
+  typedef boost::intrusive_ptr<RenderCacheView> RenderCacheViewPtr;
+
+} // namespace p44
+
+
+
+#endif /* __pixelboardd_rendercacheview_hpp__ */
@@ -873,3 +873,39 @@ PixelColor TextView::contentColorAt(int aX, int aY)
   }
 }
 
+
+void TextView::contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels)
+{
+  if (aY<0 || aY>=contentSizeY) {
+    inherited::contentRowColorsAt(aX, aY, aNumPixels, aPixels);
+    return;
+  }
+  uint8_t rowMask = 1<<(rowsPerGlyph-1-aY);
+  for (int i=0; i<aNumPixels; ++i) {
+    int x = aX+i;
+    if (x>=0 && x<contentSizeX && (textPixelCols[x] & rowMask)) {
+      aPixels[i] = textColor;
+    }
+    else {
+      aPixels[i] = backgroundColor;
+    }
+  }
+}
+
+
+void TextView::contentPremultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels)
+{
+  if (aY<0 || aY>=contentSizeY) {
+    inherited::contentPremultipliedRowColorsAt(aX, aY, aNumPixels, aPixels);
+    return;
+  }
+  // text consists of two colors only, premultiply these once
+  PremultPixelColor fg = premultipliedPixel(textColor);
+  PremultPixelColor bg = premultipliedPixel(backgroundColor);
+  uint8_t rowMask = 1<<(rowsPerGlyph-1-aY);
+  for (int i=0; i<aNumPixels; ++i) {
+    int x = aX+i;
+    aPixels[i] = x>=0 && x<contentSizeX && (textPixelCols[x] & rowMask) ? fg : bg;
+  }
+}
+
@@ -73,6 +73,12 @@ namespace p44 {
     /// get content color at X,Y
     virtual PixelColor contentColorAt(int aX, int aY) P44_OVERRIDE;
 
+    /// get a horizontal run of content pixel colors
+    virtual void contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels) P44_OVERRIDE;
+
+    /// get a horizontal run of content pixel colors with premultiplied alpha
+    virtual void contentPremultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels) P44_OVERRIDE;
+
   private:
 
     void renderText();
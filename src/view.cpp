@@ -22,13 +22,31 @@
 #include "view.hpp"
 #include "ledchaincomm.hpp" // for brightnessToPwm and pwmToBrightness
 
+#include <algorithm>
+
+// use vector instructions for row utilities where available
+#ifndef PIXELOPS_SIMD
+  #if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define PIXELOPS_SIMD 1
+  #else
+    #define PIXELOPS_SIMD 0
+  #endif
+#endif
+
+#if PIXELOPS_SIMD
+  #if defined(__SSE2__)
+    #include <emmintrin.h>
+  #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+  #endif
+#endif
+
 using namespace p44;
 
 // MARK: ===== View
 
 View::View()
 {
-  setFrame(0, 0, 0, 0);
   // default to normal orientation
   contentOrientation = right;
   // default to no content wrap
@@ -41,6 +59,8 @@ View::View()
   backgroundColor = { .r=0, .g=0, .b=0, .a=0 }; // transparent background...
   alpha = 255; // but content pixels passed trough 1:1
   targetAlpha = -1; // not fading
+  renderedExtent = infiniteRect; // nothing known about what was rendered before
+  setFrame(0, 0, 0, 0);
 }
 
 
@@ -56,16 +76,128 @@ bool View::isInContentSize(int aX, int aY)
 }
 
 
+PixelRect View::contentExtent()
+{
+  PixelRect r = { .x=0, .y=0, .dx=contentSizeX, .dy=contentSizeY };
+  return r;
+}
+
+
+PixelRect View::contentToFrameRect(const PixelRect &aRect)
+{
+  if (rectIsEmpty(aRect)) return zeroRect;
+  PixelRect r = aRect;
+  // clipped content cannot show up outside content area
+  if ((contentWrapMode&clipXY)==clipXY) {
+    PixelRect c = { .x=0, .y=0, .dx=contentSizeX, .dy=contentSizeY };
+    r = intersectRect(r, c);
+    if (rectIsEmpty(r)) return zeroRect;
+  }
+  // wrapped content repeats endlessly
+  if (contentWrapMode&wrapX) {
+    r.x = infiniteRect.x;
+    r.dx = infiniteRect.dx;
+  }
+  if (contentWrapMode&wrapY) {
+    r.y = infiniteRect.y;
+    r.dy = infiniteRect.dy;
+  }
+  // inverse of the colorAt() transformation
+  if (contentOrientation & y_flip) {
+    r.y = contentSizeY-r.y-r.dy;
+  }
+  if (contentOrientation & x_flip) {
+    r.x = contentSizeX-r.x-r.dx;
+  }
+  if (contentOrientation & xy_swap) {
+    swap(r.x, r.y);
+    swap(r.dx, r.dy);
+  }
+  r.x += originX+offsetX;
+  r.y += originY+offsetY;
+  return r;
+}
+
+
+PixelRect View::getExtent()
+{
+  if (alpha==0) return zeroRect; // invisible
+  if (backgroundColor.a!=0) {
+    // background is visible everywhere, except where content is clipped
+    if ((contentWrapMode&clipXY)!=clipXY) return infiniteRect;
+    PixelRect c = { .x=0, .y=0, .dx=contentSizeX, .dy=contentSizeY };
+    return contentToFrameRect(c);
+  }
+  return contentToFrameRect(contentExtent());
+}
+
+
+PixelRect View::getOpaqueExtent()
+{
+  if (alpha!=255 || !contentIsOpaque()) return zeroRect;
+  if (backgroundColor.a==255 && (contentWrapMode&clipXY)==0) {
+    // opaque background everywhere content is not
+    return infiniteRect;
+  }
+  // partial wrapping makes content area in frame coordinates imprecise
+  WrapMode wx = contentWrapMode&wrapX;
+  WrapMode wy = contentWrapMode&wrapY;
+  if ((wx!=0 && wx!=wrapX) || (wy!=0 && wy!=wrapY)) return zeroRect;
+  PixelRect c = { .x=0, .y=0, .dx=contentSizeX, .dy=contentSizeY };
+  return contentToFrameRect(c);
+}
+
+
+PixelRect View::dirtyRect()
+{
+  if (!dirty) return zeroRect;
+  // what was shown before as well as what is shown now needs to be redrawn
+  return unionRect(renderedExtent, getExtent());
+}
+
+
+void View::updated()
+{
+  dirty = false;
+  renderedExtent = getExtent();
+}
+
+
 void View::setFrame(int aOriginX, int aOriginY, int aSizeX, int aSizeY)
 {
   originX = aOriginX;
   originY = aOriginY;
   dX = aSizeX,
   dY = aSizeY;
+  updateTransform();
   makeDirty();
 }
 
 
+void View::updateTransform()
+{
+  // translation to the content's origin
+  int ox = -originX-offsetX;
+  int oy = -originY-offsetY;
+  // axis assignment
+  if (contentOrientation & xy_swap) {
+    tXX = 0; tXY = 1; tX = oy;
+    tYX = 1; tYY = 0; tY = ox;
+  }
+  else {
+    tXX = 1; tXY = 0; tX = ox;
+    tYX = 0; tYY = 1; tY = oy;
+  }
+  // flipping
+  if (contentOrientation & x_flip) {
+    tXX = -tXX; tXY = -tXY; tX = contentSizeX-tX-1;
+  }
+  if (contentOrientation & y_flip) {
+    tYX = -tYX; tYY = -tYY; tY = contentSizeY-tY-1;
+  }
+}
+
+
 void View::clear()
 {
   setContentSize(0, 0);
@@ -156,19 +288,9 @@ PixelColor View::colorAt(int aX, int aY)
     pc.a = 0; // entire view is invisible
   }
   else {
-    // calculate coordinate relative to the content's origin
-    int x = aX-originX-offsetX;
-    int y = aY-originY-offsetY;
     // translate into content coordinates
-    if (contentOrientation & xy_swap) {
-      swap(x, y);
-    }
-    if (contentOrientation & x_flip) {
-      x = contentSizeX-x-1;
-    }
-    if (contentOrientation & y_flip) {
-      y = contentSizeY-y-1;
-    }
+    int x = tXX*aX + tXY*aY + tX;
+    int y = tYX*aX + tYY*aY + tY;
     // optionally clip content
     if (contentWrapMode&clipXY && (
       ((contentWrapMode&clipXmin) && x<0) ||
@@ -182,14 +304,8 @@ PixelColor View::colorAt(int aX, int aY)
     else {
       // not clipped
       // optionally wrap content
-      if (contentSizeX>0) {
-        while ((contentWrapMode&wrapXmin) && x<0) x+=contentSizeX;
-        while ((contentWrapMode&wrapXmax) && x>=contentSizeX) x-=contentSizeX;
-      }
-      if (contentSizeY>0) {
-        while ((contentWrapMode&wrapYmin) && y<0) y+=contentSizeY;
-        while ((contentWrapMode&wrapYmax) && y>=contentSizeY) y-=contentSizeY;
-      }
+      x = wrappedX(x);
+      y = wrappedY(y);
       // now get content pixel
       pc = contentColorAt(x, y);
       #if SHOW_ORIGIN
@@ -219,6 +335,169 @@ PixelColor View::colorAt(int aX, int aY)
 }
 
 
+void View::contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels)
+{
+  for (int i=0; i<aNumPixels; ++i) {
+    aPixels[i] = contentColorAt(aX+i, aY);
+  }
+}
+
+
+#define PREMULTIPLY_CHUNK 256 // max number of pixels converted at once by base class contentPremultipliedRowColorsAt()
+
+void View::contentPremultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels)
+{
+  PixelColor straight[PREMULTIPLY_CHUNK];
+  for (int i=0; i<aNumPixels; i+=PREMULTIPLY_CHUNK) {
+    int n = min(PREMULTIPLY_CHUNK, aNumPixels-i);
+    contentRowColorsAt(aX+i, aY, n, straight);
+    premultiplyPixels(straight, aPixels+i, n);
+  }
+}
+
+
+void View::contentRunColorsAt(int aX, int aY, int aNumPixels, bool aReversed, PixelColor *aPixels)
+{
+  if (aReversed) {
+    // content X runs backwards: aX is the content X of the first pixel, so the run starts further left
+    aX = aX-aNumPixels+1;
+  }
+  contentRowColorsAt(aX, aY, aNumPixels, aPixels);
+  if (aReversed) {
+    std::reverse(aPixels, aPixels+aNumPixels);
+  }
+  // background is where content is fully transparent
+  for (int i=0; i<aNumPixels; ++i) {
+    if (aPixels[i].a==0) aPixels[i] = backgroundColor;
+  }
+  // factor in layer alpha
+  if (alpha!=255) {
+    for (int i=0; i<aNumPixels; ++i) {
+      aPixels[i].a = dimVal(aPixels[i].a, alpha);
+    }
+  }
+}
+
+
+void View::contentRunColorsAt(int aX, int aY, int aNumPixels, bool aReversed, PremultPixelColor *aPixels)
+{
+  if (aReversed) {
+    aX = aX-aNumPixels+1;
+  }
+  contentPremultipliedRowColorsAt(aX, aY, aNumPixels, aPixels);
+  if (aReversed) {
+    std::reverse(aPixels, aPixels+aNumPixels);
+  }
+  // background is where content is fully transparent
+  PremultPixelColor bg = premultipliedPixel(backgroundColor);
+  for (int i=0; i<aNumPixels; ++i) {
+    if (aPixels[i].a==0) aPixels[i] = bg;
+  }
+  // factor in layer alpha
+  if (alpha!=255) {
+    scalePremultipliedPixels(aPixels, aNumPixels, alpha);
+  }
+}
+
+
+void View::singleColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels)
+{
+  for (int i=0; i<aNumPixels; ++i) {
+    aPixels[i] = colorAt(aX+i, aY);
+  }
+}
+
+
+void View::singleColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels)
+{
+  for (int i=0; i<aNumPixels; ++i) {
+    aPixels[i] = premultipliedPixel(colorAt(aX+i, aY));
+  }
+}
+
+
+void View::invisibleColor(PixelColor &aColor)
+{
+  aColor = backgroundColor;
+  aColor.a = 0;
+}
+
+
+void View::invisibleColor(PremultPixelColor &aColor)
+{
+  aColor = premultTransparent;
+}
+
+
+void View::rowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels)
+{
+  renderRow(aX, aY, aNumPixels, aPixels);
+}
+
+
+void View::premultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels)
+{
+  renderRow(aX, aY, aNumPixels, aPixels);
+}
+
+
+template<typename PixelType> void View::renderRow(int aX, int aY, int aNumPixels, PixelType *aPixels)
+{
+  if (aNumPixels<=0) return;
+  // invisible pixels
+  PixelType inv;
+  invisibleColor(inv);
+  if (alpha==0) {
+    // entire view is invisible
+    for (int i=0; i<aNumPixels; ++i) aPixels[i] = inv;
+    return;
+  }
+  if (contentOrientation & xy_swap) {
+    // a view row is a content column, cannot render in runs
+    singleColorsAt(aX, aY, aNumPixels, aPixels);
+    return;
+  }
+  // content Y is the same for the entire row
+  int y = tYY*aY + tY;
+  bool clipRow =
+    ((contentWrapMode&clipYmin) && y<0) ||
+    ((contentWrapMode&clipYmax) && y>=contentSizeY);
+  if (!clipRow) y = wrappedY(y);
+  // collect runs of pixels with consecutive content X
+  bool reversed = tXX<0;
+  int runStart = 0; // index of first pixel of current run
+  int runX = 0; // content X of first pixel in current run
+  int runLen = 0; // number of pixels in current run
+  int x0 = tXX*aX + tX; // unwrapped content X of first pixel
+  for (int i=0; i<aNumPixels; ++i) {
+    int x = x0 + tXX*i;
+    if (clipRow || (
+      ((contentWrapMode&clipXmin) && x<0) ||
+      ((contentWrapMode&clipXmax) && x>=contentSizeX)
+    )) {
+      // clipped pixel ends current run
+      if (runLen>0) contentRunColorsAt(runX, y, runLen, reversed, aPixels+runStart);
+      runLen = 0;
+      aPixels[i] = inv;
+      continue;
+    }
+    x = wrappedX(x);
+    if (runLen>0 && x==runX+tXX*runLen) {
+      // continues current run
+      runLen++;
+    }
+    else {
+      // start new run
+      if (runLen>0) contentRunColorsAt(runX, y, runLen, reversed, aPixels+runStart);
+      runStart = i;
+      runX = x;
+      runLen = 1;
+    }
+  }
+  if (runLen>0) contentRunColorsAt(runX, y, runLen, reversed, aPixels+runStart);
+}
+
+
 // MARK: ===== Utilities
 
 uint8_t p44::dimVal(uint8_t aVal, uint16_t aDim)
@@ -291,64 +570,135 @@ void p44::overlayPixel(PixelColor &aPixel, PixelColor aOverlay)
 }
 
 
-void p44::mixinPixel(PixelColor &aMainPixel, PixelColor aOutsidePixel, uint8_t aAmountOutside)
+// MARK: ===== Energy domain mixing tables
+
+/// precomputed tables for mixing pixels in the energy (PWM) domain
+/// @note the brightness/PWM curve is defined by p44utils' brightnessToPwm()/pwmToBrightness(),
+///   so the tables are derived from these once, to yield exactly the same results.
+class MixTables
 {
-  if (aAmountOutside>0) {
-    if (aMainPixel.a!=255 || aOutsidePixel.a!=255) {
-      // mixed transparency
-      uint8_t alpha = dimVal(aMainPixel.a, pwmToBrightness(255-aAmountOutside)) + dimVal(aOutsidePixel.a, pwmToBrightness(aAmountOutside));
-      if (alpha>0) {
-        // calculation only needed for non-transparent result
-        // - alpha boost compensates for energy
-        uint16_t ab = 65025/alpha;
-        // Note: aAmountOutside is on the energy scale, not brightness, so need to add in PWM scale!
-        uint16_t r_e = ( (((uint16_t)brightnessToPwm(dimVal(aMainPixel.r, aMainPixel.a))+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(dimVal(aOutsidePixel.r, aOutsidePixel.a))+1)*(aAmountOutside)) )>>8;
-        uint16_t g_e = ( (((uint16_t)brightnessToPwm(dimVal(aMainPixel.g, aMainPixel.a))+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(dimVal(aOutsidePixel.g, aOutsidePixel.a))+1)*(aAmountOutside)) )>>8;
-        uint16_t b_e = ( (((uint16_t)brightnessToPwm(dimVal(aMainPixel.b, aMainPixel.a))+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(dimVal(aOutsidePixel.b, aOutsidePixel.a))+1)*(aAmountOutside)) )>>8;
-        // - back to brightness, add alpha boost
-        uint16_t r = (((uint16_t)pwmToBrightness(r_e)+1)*ab)>>8;
-        uint16_t g = (((uint16_t)pwmToBrightness(g_e)+1)*ab)>>8;
-        uint16_t b = (((uint16_t)pwmToBrightness(b_e)+1)*ab)>>8;
-        // - check max brightness
-        uint16_t m = r; if (g>m) m = g; if (b>m) m = b;
-        if (m>255) {
-          // more brightness requested than we have
-          // - scale down to make max=255
-          uint16_t cr = 65025/m;
-          r = (r*cr)>>8;
-          g = (g*cr)>>8;
-          b = (b*cr)>>8;
-          // - increase alpha by reduction of components
-          alpha = (((uint16_t)alpha+1)*m)>>8;
-          aMainPixel.r = r>255 ? 255 : r;
-          aMainPixel.g = g>255 ? 255 : g;
-          aMainPixel.b = b>255 ? 255 : b;
-          aMainPixel.a = alpha>255 ? 255 : alpha;
-        }
-        else {
-          // brightness below max, just convert back
-          aMainPixel.r = r;
-          aMainPixel.g = g;
-          aMainPixel.b = b;
-          aMainPixel.a = alpha;
-        }
+public:
+  /// brightness value weighted on the energy scale: (brightnessToPwm(brightness)+1)*amount
+  uint16_t weightedEnergy[256][256]; // [amount][brightness]
+  /// pwmToBrightness() as a table
+  uint8_t brightness[256]; // [pwm]
+  /// alpha boost compensating for energy: 65025/alpha
+  uint16_t alphaBoost[256]; // [alpha]
+
+  MixTables()
+  {
+    for (int v=0; v<256; v++) {
+      brightness[v] = pwmToBrightness(v);
+      alphaBoost[v] = v>0 ? 65025/v : 0;
+      uint16_t e = (uint16_t)brightnessToPwm(v)+1;
+      for (int amount=0; amount<256; amount++) {
+        weightedEnergy[amount][v] = e*amount;
+      }
+    }
+  }
+};
+
+/// @return the mixing tables, initialized at first use
+static const MixTables &mixTables()
+{
+  static MixTables tables;
+  return tables;
+}
+
+
+
+static inline void mixinPixelWithTables(const MixTables &aT, PixelColor &aMainPixel, PixelColor aOutsidePixel, uint8_t aAmountOutside)
+{
+  // Note: aAmountOutside is on the energy scale, not brightness, so need to add in PWM scale!
+  const uint16_t *mainW = aT.weightedEnergy[255-aAmountOutside];
+  const uint16_t *outsideW = aT.weightedEnergy[aAmountOutside];
+  if (aMainPixel.a!=255 || aOutsidePixel.a!=255) {
+    // mixed transparency
+    uint8_t alpha = dimVal(aMainPixel.a, aT.brightness[255-aAmountOutside]) + dimVal(aOutsidePixel.a, aT.brightness[aAmountOutside]);
+    if (alpha>0) {
+      // calculation only needed for non-transparent result
+      // - alpha boost compensates for energy
+      uint16_t ab = aT.alphaBoost[alpha];
+      uint16_t r_e = (mainW[dimVal(aMainPixel.r, aMainPixel.a)] + outsideW[dimVal(aOutsidePixel.r, aOutsidePixel.a)])>>8;
+      uint16_t g_e = (mainW[dimVal(aMainPixel.g, aMainPixel.a)] + outsideW[dimVal(aOutsidePixel.g, aOutsidePixel.a)])>>8;
+      uint16_t b_e = (mainW[dimVal(aMainPixel.b, aMainPixel.a)] + outsideW[dimVal(aOutsidePixel.b, aOutsidePixel.a)])>>8;
+      // - back to brightness, add alpha boost
+      uint16_t r = (((uint16_t)aT.brightness[r_e]+1)*ab)>>8;
+      uint16_t g = (((uint16_t)aT.brightness[g_e]+1)*ab)>>8;
+      uint16_t b = (((uint16_t)aT.brightness[b_e]+1)*ab)>>8;
+      // - check max brightness
+      uint16_t m = r; if (g>m) m = g; if (b>m) m = b;
+      if (m>255) {
+        // more brightness requested than we have
+        // - scale down to make max=255
+        uint16_t cr = 65025/m;
+        r = (r*cr)>>8;
+        g = (g*cr)>>8;
+        b = (b*cr)>>8;
+        // - increase alpha by reduction of components
+        alpha = (((uint16_t)alpha+1)*m)>>8;
+        aMainPixel.r = r>255 ? 255 : r;
+        aMainPixel.g = g>255 ? 255 : g;
+        aMainPixel.b = b>255 ? 255 : b;
+        aMainPixel.a = alpha>255 ? 255 : alpha;
       }
       else {
-        // resulting alpha is 0, fully transparent pixel
-        aMainPixel = transparent;
+        // brightness below max, just convert back
+        aMainPixel.r = r;
+        aMainPixel.g = g;
+        aMainPixel.b = b;
+        aMainPixel.a = alpha;
       }
     }
     else {
-      // no transparency on either side, simplified case
-      uint16_t r_e = ( (((uint16_t)brightnessToPwm(aMainPixel.r)+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(aOutsidePixel.r)+1)*(aAmountOutside)) )>>8;
-      uint16_t g_e = ( (((uint16_t)brightnessToPwm(aMainPixel.g)+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(aOutsidePixel.g)+1)*(aAmountOutside)) )>>8;
-      uint16_t b_e = ( (((uint16_t)brightnessToPwm(aMainPixel.b)+1)*(255-aAmountOutside)) + (((uint16_t)brightnessToPwm(aOutsidePixel.b)+1)*(aAmountOutside)) )>>8;
-      aMainPixel.r = r_e>255 ? 255 : pwmToBrightness(r_e);
-      aMainPixel.g = g_e>255 ? 255 : pwmToBrightness(g_e);
-      aMainPixel.b = b_e>255 ? 255 : pwmToBrightness(b_e);
-      aMainPixel.a = 255;
+      // resulting alpha is 0, fully transparent pixel
+      aMainPixel = transparent;
     }
   }
+  else {
+    // no transparency on either side, simplified case
+    // Note: weighted energies of both sides never sum up to more than 255<<8
+    aMainPixel.r = aT.brightness[(mainW[aMainPixel.r] + outsideW[aOutsidePixel.r])>>8];
+    aMainPixel.g = aT.brightness[(mainW[aMainPixel.g] + outsideW[aOutsidePixel.g])>>8];
+    aMainPixel.b = aT.brightness[(mainW[aMainPixel.b] + outsideW[aOutsidePixel.b])>>8];
+    aMainPixel.a = 255;
+  }
+}
+
+
+void p44::mixinPixel(PixelColor &aMainPixel, PixelColor aOutsidePixel, uint8_t aAmountOutside)
+{
+  if (aAmountOutside>0) {
+    mixinPixelWithTables(mixTables(), aMainPixel, aOutsidePixel, aAmountOutside);
+  }
+}
+
+
+PremultPixelColor p44::premultipliedPixel(PixelColor aPix)
+{
+  PremultPixelColor p;
+  p.r = dimVal(aPix.r, aPix.a);
+  p.g = dimVal(aPix.g, aPix.a);
+  p.b = dimVal(aPix.b, aPix.a);
+  p.a = aPix.a;
+  return p;
+}
+
+
+void p44::addToPixel(PremultPixelColor &aPixel, PremultPixelColor aPixelToAdd)
+{
+  increase(aPixel.r, aPixelToAdd.r);
+  increase(aPixel.g, aPixelToAdd.g);
+  increase(aPixel.b, aPixelToAdd.b);
+}
+
+
+void p44::scalePremultipliedPixel(PremultPixelColor &aPix, uint8_t aScale)
+{
+  aPix.r = dimVal(aPix.r, aScale);
+  aPix.g = dimVal(aPix.g, aScale);
+  aPix.b = dimVal(aPix.b, aScale);
+  aPix.a = dimVal(aPix.a, aScale);
 }
 
 
@@ -360,6 +710,279 @@ void p44::addToPixel(PixelColor &aPixel, PixelColor aPixelToAdd)
 }
 
 
+bool p44::rectIsEmpty(const PixelRect &aRect)
+{
+  return aRect.dx<=0 || aRect.dy<=0;
+}
+
+
+PixelRect p44::unionRect(const PixelRect &aRect1, const PixelRect &aRect2)
+{
+  if (rectIsEmpty(aRect1)) return aRect2;
+  if (rectIsEmpty(aRect2)) return aRect1;
+  PixelRect r;
+  r.x = min(aRect1.x, aRect2.x);
+  r.y = min(aRect1.y, aRect2.y);
+  r.dx = max(aRect1.x+aRect1.dx, aRect2.x+aRect2.dx)-r.x;
+  r.dy = max(aRect1.y+aRect1.dy, aRect2.y+aRect2.dy)-r.y;
+  return r;
+}
+
+
+PixelRect p44::intersectRect(const PixelRect &aRect1, const PixelRect &aRect2)
+{
+  PixelRect r;
+  r.x = max(aRect1.x, aRect2.x);
+  r.y = max(aRect1.y, aRect2.y);
+  r.dx = min(aRect1.x+aRect1.dx, aRect2.x+aRect2.dx)-r.x;
+  r.dy = min(aRect1.y+aRect1.dy, aRect2.y+aRect2.dy)-r.y;
+  if (rectIsEmpty(r)) return zeroRect;
+  return r;
+}
+
+
+// MARK: ===== Row utilities
+
+#if PIXELOPS_SIMD && defined(__SSE2__)
+
+// SSE2: 4 pixels per 128 bit register, processed as 2*2 pixels with 16 bit components
+
+static inline __m128i sse_alphaMask()
+{
+  return _mm_set1_epi32(0xFF000000); // alpha is the 4th byte of each pixel
+}
+
+
+static inline __m128i sse_broadcastAlpha(__m128i aPix16)
+{
+  // replicate alpha component of both pixels into all of their component lanes
+  return _mm_shufflehi_epi16(_mm_shufflelo_epi16(aPix16, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+}
+
+
+static inline __m128i sse_dim16(__m128i aPix16, __m128i aFactor16)
+{
+  // (v*factor)>>8, factor must be <=256
+  return _mm_srli_epi16(_mm_mullo_epi16(aPix16, aFactor16), 8);
+}
+
+#elif PIXELOPS_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+
+// NEON: 8 pixels at a time, de-interleaved into separate r,g,b,a registers
+
+static inline uint8x8_t neon_dim(uint8x8_t aComp, uint16x8_t aFactor16)
+{
+  // (v*factor)>>8, factor must be <=256
+  return vshrn_n_u16(vmulq_u16(vmovl_u8(aComp), aFactor16), 8);
+}
+
+#endif
+
+
+void p44::dimPixels(PixelColor *aPixels, int aNumPixels, uint16_t aDim)
+{
+  int i = 0;
+  #if PIXELOPS_SIMD && defined(__SSE2__)
+  if (aDim<=255) {
+    // no overflow possible
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i amask = sse_alphaMask();
+    const __m128i f = _mm_set1_epi16(aDim+1);
+    for (; i+4<=aNumPixels; i+=4) {
+      __m128i v = _mm_loadu_si128((__m128i *)(aPixels+i));
+      __m128i lo = sse_dim16(_mm_unpacklo_epi8(v, zero), f);
+      __m128i hi = sse_dim16(_mm_unpackhi_epi8(v, zero), f);
+      __m128i r = _mm_packus_epi16(lo, hi);
+      r = _mm_or_si128(_mm_andnot_si128(amask, r), _mm_and_si128(amask, v));
+      _mm_storeu_si128((__m128i *)(aPixels+i), r);
+    }
+  }
+  #elif PIXELOPS_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+  if (aDim<=255) {
+    // no overflow possible
+    const uint16x8_t f = vdupq_n_u16(aDim+1);
+    for (; i+8<=aNumPixels; i+=8) {
+      uint8x8x4_t v = vld4_u8((uint8_t *)(aPixels+i));
+      v.val[0] = neon_dim(v.val[0], f);
+      v.val[1] = neon_dim(v.val[1], f);
+      v.val[2] = neon_dim(v.val[2], f);
+      vst4_u8((uint8_t *)(aPixels+i), v);
+    }
+  }
+  #endif
+  for (; i<aNumPixels; ++i) {
+    dimPixel(aPixels[i], aDim);
+  }
+}
+
+
+/// dim r,g,b of 4-byte RGBA pixels by their alpha, from aSrc into aDst (which may be the same buffer)
+/// @note common implementation for alphaDimPixels() and premultiplyPixels()
+static void alphaDimRGBA(const uint8_t *aSrc, uint8_t *aDst, int aNumPixels)
+{
+  int i = 0;
+  #if PIXELOPS_SIMD && defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i amask = sse_alphaMask();
+  for (; i+4<=aNumPixels; i+=4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(aSrc+4*i));
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    lo = sse_dim16(lo, _mm_add_epi16(sse_broadcastAlpha(lo), one));
+    hi = sse_dim16(hi, _mm_add_epi16(sse_broadcastAlpha(hi), one));
+    __m128i r = _mm_packus_epi16(lo, hi);
+    r = _mm_or_si128(_mm_andnot_si128(amask, r), _mm_and_si128(amask, v));
+    _mm_storeu_si128((__m128i *)(aDst+4*i), r);
+  }
+  #elif PIXELOPS_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+  for (; i+8<=aNumPixels; i+=8) {
+    uint8x8x4_t v = vld4_u8(aSrc+4*i);
+    uint16x8_t f = vaddw_u8(vdupq_n_u16(1), v.val[3]);
+    v.val[0] = neon_dim(v.val[0], f);
+    v.val[1] = neon_dim(v.val[1], f);
+    v.val[2] = neon_dim(v.val[2], f);
+    vst4_u8(aDst+4*i, v);
+  }
+  #endif
+  for (; i<aNumPixels; ++i) {
+    const uint8_t *s = aSrc+4*i;
+    uint8_t *d = aDst+4*i;
+    uint8_t a = s[3];
+    d[0] = dimVal(s[0], a);
+    d[1] = dimVal(s[1], a);
+    d[2] = dimVal(s[2], a);
+    d[3] = a;
+  }
+}
+
+
+void p44::alphaDimPixels(PixelColor *aPixels, int aNumPixels)
+{
+  alphaDimRGBA((const uint8_t *)aPixels, (uint8_t *)aPixels, aNumPixels);
+}
+
+
+void p44::premultiplyPixels(const PixelColor *aPixels, PremultPixelColor *aPremultPixels, int aNumPixels)
+{
+  alphaDimRGBA((const uint8_t *)aPixels, (uint8_t *)aPremultPixels, aNumPixels);
+}
+
+
+void p44::addToPixels(PixelColor *aPixels, const PixelColor *aPixelsToAdd, int aNumPixels)
+{
+  int i = 0;
+  #if PIXELOPS_SIMD && defined(__SSE2__)
+  const __m128i amask = sse_alphaMask();
+  for (; i+4<=aNumPixels; i+=4) {
+    __m128i v = _mm_loadu_si128((__m128i *)(aPixels+i));
+    __m128i a = _mm_andnot_si128(amask, _mm_loadu_si128((const __m128i *)(aPixelsToAdd+i)));
+    _mm_storeu_si128((__m128i *)(aPixels+i), _mm_adds_epu8(v, a));
+  }
+  #elif PIXELOPS_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+  for (; i+8<=aNumPixels; i+=8) {
+    uint8x8x4_t v = vld4_u8((uint8_t *)(aPixels+i));
+    uint8x8x4_t a = vld4_u8((const uint8_t *)(aPixelsToAdd+i));
+    v.val[0] = vqadd_u8(v.val[0], a.val[0]);
+    v.val[1] = vqadd_u8(v.val[1], a.val[1]);
+    v.val[2] = vqadd_u8(v.val[2], a.val[2]);
+    vst4_u8((uint8_t *)(aPixels+i), v);
+  }
+  #endif
+  for (; i<aNumPixels; ++i) {
+    addToPixel(aPixels[i], aPixelsToAdd[i]);
+  }
+}
+
+
+void p44::overlayPixels(PixelColor *aPixels, const PixelColor *aOverlays, int aNumPixels)
+{
+  // Note: vector versions do not special-case fully opaque overlays, the general
+  //   formula yields the same result for those
+  int i = 0;
+  #if PIXELOPS_SIMD && defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i full = _mm_set1_epi16(256);
+  const __m128i amask = sse_alphaMask();
+  for (; i+4<=aNumPixels; i+=4) {
+    __m128i v = _mm_loadu_si128((__m128i *)(aPixels+i));
+    __m128i o = _mm_loadu_si128((const __m128i *)(aOverlays+i));
+    __m128i olo = _mm_unpacklo_epi8(o, zero);
+    __m128i ohi = _mm_unpackhi_epi8(o, zero);
+    __m128i alo = sse_broadcastAlpha(olo);
+    __m128i ahi = sse_broadcastAlpha(ohi);
+    // - reduce original by alpha of overlay
+    __m128i vlo = sse_dim16(_mm_unpacklo_epi8(v, zero), _mm_sub_epi16(full, alo));
+    __m128i vhi = sse_dim16(_mm_unpackhi_epi8(v, zero), _mm_sub_epi16(full, ahi));
+    // - reduce overlay by its own alpha
+    olo = sse_dim16(olo, _mm_add_epi16(alo, one));
+    ohi = sse_dim16(ohi, _mm_add_epi16(ahi, one));
+    // - add in, result is never transparent
+    __m128i r = _mm_adds_epu8(_mm_packus_epi16(vlo, vhi), _mm_andnot_si128(amask, _mm_packus_epi16(olo, ohi)));
+    _mm_storeu_si128((__m128i *)(aPixels+i), _mm_or_si128(r, amask));
+  }
+  #elif PIXELOPS_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+  for (; i+8<=aNumPixels; i+=8) {
+    uint8x8x4_t v = vld4_u8((uint8_t *)(aPixels+i));
+    uint8x8x4_t o = vld4_u8((const uint8_t *)(aOverlays+i));
+    uint16x8_t fv = vsubw_u8(vdupq_n_u16(256), o.val[3]); // reduce original by alpha of overlay
+    uint16x8_t fo = vaddw_u8(vdupq_n_u16(1), o.val[3]); // reduce overlay by its own alpha
+    v.val[0] = vqadd_u8(neon_dim(v.val[0], fv), neon_dim(o.val[0], fo));
+    v.val[1] = vqadd_u8(neon_dim(v.val[1], fv), neon_dim(o.val[1], fo));
+    v.val[2] = vqadd_u8(neon_dim(v.val[2], fv), neon_dim(o.val[2], fo));
+    v.val[3] = vdup_n_u8(255); // result is never transparent
+    vst4_u8((uint8_t *)(aPixels+i), v);
+  }
+  #endif
+  for (; i<aNumPixels; ++i) {
+    overlayPixel(aPixels[i], aOverlays[i]);
+  }
+}
+
+
+void p44::mixinPixels(PixelColor *aMainPixels, const PixelColor *aOutsidePixels, int aNumPixels, uint8_t aAmountOutside)
+{
+  // Note: mixing is dominated by the energy table lookups, which cannot be vectorized
+  //   without gather instructions, so this is a plain loop. But as the amount is the same
+  //   for all pixels, only two rows of the weighted energy table are in use.
+  if (aAmountOutside==0) return; // nothing to mix in
+  const MixTables &t = mixTables();
+  for (int i=0; i<aNumPixels; ++i) {
+    mixinPixelWithTables(t, aMainPixels[i], aOutsidePixels[i], aAmountOutside);
+  }
+}
+
+
+void p44::scalePremultipliedPixels(PremultPixelColor *aPixels, int aNumPixels, uint8_t aScale)
+{
+  int i = 0;
+  #if PIXELOPS_SIMD && defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i f = _mm_set1_epi16((uint16_t)aScale+1);
+  for (; i+4<=aNumPixels; i+=4) {
+    __m128i v = _mm_loadu_si128((__m128i *)(aPixels+i));
+    __m128i lo = sse_dim16(_mm_unpacklo_epi8(v, zero), f);
+    __m128i hi = sse_dim16(_mm_unpackhi_epi8(v, zero), f);
+    _mm_storeu_si128((__m128i *)(aPixels+i), _mm_packus_epi16(lo, hi));
+  }
+  #elif PIXELOPS_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+  const uint16x8_t f = vdupq_n_u16((uint16_t)aScale+1);
+  for (; i+8<=aNumPixels; i+=8) {
+    uint8x8x4_t v = vld4_u8((uint8_t *)(aPixels+i));
+    v.val[0] = neon_dim(v.val[0], f);
+    v.val[1] = neon_dim(v.val[1], f);
+    v.val[2] = neon_dim(v.val[2], f);
+    v.val[3] = neon_dim(v.val[3], f);
+    vst4_u8((uint8_t *)(aPixels+i), v);
+  }
+  #endif
+  for (; i<aNumPixels; ++i) {
+    scalePremultipliedPixel(aPixels[i], aScale);
+  }
+}
+
+
 PixelColor p44::webColorToPixel(const string aWebColor)
 {
   PixelColor res = transparent;
@@ -34,8 +34,31 @@ namespace p44 {
     uint8_t a; // alpha
   } PixelColor;
 
+  /// pixel color with r,g,b already scaled by alpha (premultiplied alpha)
+  /// @note deliberately a distinct type from PixelColor (with the same memory layout), so
+  ///   premultiplied and straight alpha pixels cannot be mixed up
+  typedef struct {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a; // alpha
+  } PremultPixelColor;
+
   const PixelColor transparent = { .r=0, .g=0, .b=0, .a=0 };
   const PixelColor black = { .r=0, .g=0, .b=0, .a=255 };
+  const PremultPixelColor premultTransparent = { .r=0, .g=0, .b=0, .a=0 };
+  const PremultPixelColor premultBlack = { .r=0, .g=0, .b=0, .a=255 };
+
+  typedef struct {
+    int x;
+    int y;
+    int dx;
+    int dy;
+  } PixelRect;
+
+  const PixelRect zeroRect = { .x=0, .y=0, .dx=0, .dy=0 };
+  /// practically unlimited rectangle, for areas that cannot be bounded (e.g. wrapped content or background)
+  const PixelRect infiniteRect = { .x=-0x10000000, .y=-0x10000000, .dx=0x20000000, .dy=0x20000000 };
 
   /// Utilities
   /// @{
@@ -90,6 +113,75 @@ namespace p44 {
   /// @param aAmountOutside 0..255 (= 0..100%) value to determine how much weight the outside pixel should get in the result
   void mixinPixel(PixelColor &aMainPixel, PixelColor aOutsidePixel, uint8_t aAmountOutside);
 
+  /// Row utilities
+  /// @note these process arrays of pixels (e.g. entire rows) and deliver exactly the same results as
+  ///   applying the corresponding single pixel utility to each pixel. Depending on the target
+  ///   architecture, SSE2 or NEON vector instructions are used (see PIXELOPS_SIMD in view.cpp)
+
+  /// dim r,g,b values of multiple pixels (alpha unaffected)
+  /// @param aPixels the pixels
+  /// @param aNumPixels number of pixels
+  /// @param aDim 0..255: dim, >255: light up (255=100%)
+  void dimPixels(PixelColor *aPixels, int aNumPixels, uint16_t aDim);
+
+  /// dim r,g,b values of multiple pixels each by its own alpha value (alpha unaffected)
+  /// @param aPixels the pixels
+  /// @param aNumPixels number of pixels
+  /// @note same as aPixel = dimmedPixel(aPixel, aPixel.a) for every pixel, i.e. converts
+  ///   pixels to premultiplied alpha
+  void alphaDimPixels(PixelColor *aPixels, int aNumPixels);
+
+  /// add colors of multiple pixels to other pixels
+  /// @param aPixels the pixels to add to
+  /// @param aPixelsToAdd the pixels to add
+  /// @param aNumPixels number of pixels
+  void addToPixels(PixelColor *aPixels, const PixelColor *aPixelsToAdd, int aNumPixels);
+
+  /// overlay multiple pixels on top of other pixels (based on alpha values)
+  /// @param aPixels the original pixels to add the overlays to
+  /// @param aOverlays the pixels to be laid on top
+  /// @param aNumPixels number of pixels
+  void overlayPixels(PixelColor *aPixels, const PixelColor *aOverlays, int aNumPixels);
+
+  /// mix multiple pixels
+  /// @param aMainPixels the original pixels which will be modified to contain the mix
+  /// @param aOutsidePixels the pixels to mix in
+  /// @param aNumPixels number of pixels
+  /// @param aAmountOutside 0..255 (= 0..100%) value to determine how much weight the outside pixels should get in the result
+  void mixinPixels(PixelColor *aMainPixels, const PixelColor *aOutsidePixels, int aNumPixels, uint8_t aAmountOutside);
+
+  /// Premultiplied alpha utilities
+
+  /// convert pixel to premultiplied alpha
+  /// @param aPix the pixel with straight alpha
+  /// @return premultiplied pixel
+  PremultPixelColor premultipliedPixel(PixelColor aPix);
+
+  /// convert multiple pixels to premultiplied alpha
+  /// @param aPixels the pixels with straight alpha
+  /// @param aPremultPixels receives the premultiplied pixels
+  /// @param aNumPixels number of pixels
+  /// @note same as aPremultPixels[i] = premultipliedPixel(aPixels[i]) for every pixel
+  void premultiplyPixels(const PixelColor *aPixels, PremultPixelColor *aPremultPixels, int aNumPixels);
+
+  /// add color of one premultiplied pixel to another
+  /// @note does not check for color component overflow/wraparound!
+  /// @param aPixel the pixel to add to
+  /// @param aPixelToAdd the pixel to add
+  void addToPixel(PremultPixelColor &aPixel, PremultPixelColor aPixelToAdd);
+
+  /// scale all components including alpha of a premultiplied pixel
+  /// @param aPix the premultiplied pixel
+  /// @param aScale 0..255 (255=100%)
+  void scalePremultipliedPixel(PremultPixelColor &aPix, uint8_t aScale);
+
+  /// scale all components including alpha of multiple premultiplied pixels
+  /// @param aPixels the premultiplied pixels
+  /// @param aNumPixels number of pixels
+  /// @param aScale 0..255 (255=100%)
+  /// @note this is how alpha is applied to premultiplied pixels
+  void scalePremultipliedPixels(PremultPixelColor *aPixels, int aNumPixels, uint8_t aScale);
+
   /// convert Web color to pixel color
   /// @param aWebColor web style #ARGB or #AARRGGBB color, alpha (A, AA) is optional, "#" is also optional
   /// @return pixel color. If Alpha is not specified, it is set to fully opaque = 255.
@@ -100,6 +192,23 @@ namespace p44 {
   /// @return web color in RRGGBB style or AARRGGBB when alpha is not fully opaque (==255)
   string pixelToWebColor(const PixelColor aPixelColor);
 
+  /// check for empty rectangle
+  /// @param aRect the rectangle
+  /// @return true if rectangle does not contain any pixels
+  bool rectIsEmpty(const PixelRect &aRect);
+
+  /// union of two rectangles
+  /// @param aRect1 first rectangle
+  /// @param aRect2 second rectangle
+  /// @return smallest rectangle containing both rectangles (empty rectangles are ignored)
+  PixelRect unionRect(const PixelRect &aRect1, const PixelRect &aRect2);
+
+  /// intersection of two rectangles
+  /// @param aRect1 first rectangle
+  /// @param aRect2 second rectangle
+  /// @return rectangle covered by both rectangles, zeroRect if rectangles do not overlap
+  PixelRect intersectRect(const PixelRect &aRect1, const PixelRect &aRect2);
+
 
   /// @}
 
@@ -109,6 +218,7 @@ namespace p44 {
     friend class ViewStack;
 
     bool dirty;
+    PixelRect renderedExtent; ///< extent of the view at the time of the last updated() call
 
     /// fading
     int targetAlpha; ///< alpha to reach at end of fading, -1 = not fading
@@ -175,6 +285,12 @@ namespace p44 {
     int contentSizeY; ///< Y size of content (in content coordinates)
     WrapMode contentWrapMode; ///< content wrap mode
 
+    // frame to content coordinate transformation, derived from frame, offset, orientation and content size
+    // contentX = tXX*x + tXY*y + tX
+    // contentY = tYX*x + tYY*y + tY
+    int tXX, tXY, tX;
+    int tYX, tYY, tY;
+
     /// get content pixel color
     /// @param aX content X coordinate
     /// @param aY content Y coordinate
@@ -182,12 +298,98 @@ namespace p44 {
     ///   implementation must check this!
     virtual PixelColor contentColorAt(int aX, int aY) { return backgroundColor; }
 
+    /// get a horizontal run of content pixel colors
+    /// @param aX content X coordinate of the first pixel
+    /// @param aY content Y coordinate
+    /// @param aNumPixels number of pixels to get
+    /// @param aPixels buffer to store the pixel colors, must have room for aNumPixels
+    /// @note aX..aX+aNumPixels-1 and aY are NOT guaranteed to be within actual content as defined by contentSizeX/Y
+    ///   implementation must check this!
+    /// @note base class just calls contentColorAt() for each pixel, subclasses should override this
+    ///   with a more efficient implementation
+    virtual void contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels);
+
+    /// get a horizontal run of content pixel colors with premultiplied alpha
+    /// @param aX content X coordinate of the first pixel
+    /// @param aY content Y coordinate
+    /// @param aNumPixels number of pixels to get
+    /// @param aPixels buffer to store the premultiplied pixel colors, must have room for aNumPixels
+    /// @note same range rules as for contentRowColorsAt() apply
+    /// @note base class converts the result of contentRowColorsAt(), subclasses that have premultiplied
+    ///   data at hand or can composite more efficiently in premultiplied alpha should override this
+    virtual void contentPremultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels);
+
     /// helper for implementations: check if aX/aY within set content size
     bool isInContentSize(int aX, int aY);
 
+    /// get the area where content can be non-transparent
+    /// @return rectangle in content coordinates
+    /// @note base class returns the content size area, subclasses with content not limited
+    ///   to the content size must override this
+    virtual PixelRect contentExtent();
+
+    /// @return true if all content pixels within the content size are fully opaque
+    /// @note base class returns false, subclasses knowing their content is opaque should override this
+    ///   to allow parent views to skip rendering what is behind them
+    virtual bool contentIsOpaque() { return false; }
+
+    /// transform a rectangle in content coordinates into frame (parent view) coordinates
+    /// @param aRect rectangle in content coordinates
+    /// @return rectangle in frame coordinates, covering all pixels the content rectangle might
+    ///   show up in (i.e. unlimited in directions where content wraps)
+    PixelRect contentToFrameRect(const PixelRect &aRect);
+
     /// set dirty - to be called by step() implementation when the view needs to be redisplayed
     void makeDirty() { dirty = true; };
 
+    /// wrap content X coordinate according to wrap mode
+    /// @param aX content X coordinate
+    /// @return content X coordinate wrapped into content size if wrap mode requires it
+    int wrappedX(int aX) const
+    {
+      if (contentSizeX>0 && ((aX<0 && (contentWrapMode&wrapXmin)) || (aX>=contentSizeX && (contentWrapMode&wrapXmax)))) {
+        aX %= contentSizeX;
+        if (aX<0) aX += contentSizeX;
+      }
+      return aX;
+    }
+
+    /// wrap content Y coordinate according to wrap mode
+    /// @param aY content Y coordinate
+    /// @return content Y coordinate wrapped into content size if wrap mode requires it
+    int wrappedY(int aY) const
+    {
+      if (contentSizeY>0 && ((aY<0 && (contentWrapMode&wrapYmin)) || (aY>=contentSizeY && (contentWrapMode&wrapYmax)))) {
+        aY %= contentSizeY;
+        if (aY<0) aY += contentSizeY;
+      }
+      return aY;
+    }
+
+    /// recalculate frame to content coordinate transformation
+    /// @note must be called whenever frame, content offset, orientation or content size changes
+    void updateTransform();
+
+  private:
+
+    /// get a run of content pixels with consecutive content X coordinates and apply background and alpha
+    void contentRunColorsAt(int aX, int aY, int aNumPixels, bool aReversed, PixelColor *aPixels);
+
+    /// get a run of premultiplied content pixels (via contentPremultipliedRowColorsAt()) with consecutive
+    /// content X coordinates and apply background and alpha
+    void contentRunColorsAt(int aX, int aY, int aNumPixels, bool aReversed, PremultPixelColor *aPixels);
+
+    /// get pixels one by one via colorAt(), for when a view row is not a content row
+    void singleColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels);
+    void singleColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels);
+
+    /// color of pixels outside the visible content
+    void invisibleColor(PixelColor &aColor);
+    void invisibleColor(PremultPixelColor &aColor);
+
+    /// common implementation for rowColorsAt() and premultipliedRowColorsAt()
+    template<typename PixelType> void renderRow(int aX, int aY, int aNumPixels, PixelType *aPixels);
+
   public :
 
     /// create view
@@ -246,13 +448,13 @@ namespace p44 {
     void stopFading();
 
     /// @param aOrientation the orientation of the content
-    void setOrientation(Orientation aOrientation) { contentOrientation = aOrientation; makeDirty(); }
+    void setOrientation(Orientation aOrientation) { contentOrientation = aOrientation; updateTransform(); makeDirty(); }
 
     /// set content offset
-    void setContentOffset(int aOffsetX, int aOffsetY) { offsetX = aOffsetX; offsetY = aOffsetY; makeDirty(); };
+    void setContentOffset(int aOffsetX, int aOffsetY) { offsetX = aOffsetX; offsetY = aOffsetY; updateTransform(); makeDirty(); };
 
     /// set content size
-    void setContentSize(int aSizeX, int aSizeY) { contentSizeX = aSizeX; contentSizeY = aSizeY; makeDirty(); };
+    void setContentSize(int aSizeX, int aSizeY) { contentSizeX = aSizeX; contentSizeY = aSizeY; updateTransform(); makeDirty(); };
 
     /// @return content size X
     int getContentSizeX() const { return contentSizeX; }
@@ -269,6 +471,24 @@ namespace p44 {
     /// @param aY PlayField Y coordinate
     PixelColor colorAt(int aX, int aY);
 
+    /// get colors of a horizontal run of pixels
+    /// @param aX PlayField X coordinate of the first pixel
+    /// @param aY PlayField Y coordinate
+    /// @param aNumPixels number of pixels to get
+    /// @param aPixels buffer to store the pixel colors, must have room for aNumPixels
+    /// @note result is the same as calling colorAt() for every pixel, but avoids
+    ///   walking the view hierarchy separately for each pixel
+    void rowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels);
+
+    /// get premultiplied alpha colors of a horizontal run of pixels
+    /// @param aX PlayField X coordinate of the first pixel
+    /// @param aY PlayField Y coordinate
+    /// @param aNumPixels number of pixels to get
+    /// @param aPixels buffer to store the premultiplied pixel colors, must have room for aNumPixels
+    /// @note result is the same as rowColorsAt() followed by alphaDimPixels(), except for rounding
+    ///   differences in views that composite in premultiplied alpha (e.g. ViewStack)
+    void premultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels);
+
     /// clear contents of this view
     /// @note base class just resets content size to zero, subclasses might NOT want to do that
     ///   and thus choose NOT to call inherited.
@@ -282,8 +502,21 @@ namespace p44 {
     /// return if anything changed on the display since last call
     virtual bool isDirty() { return dirty; };
 
+    /// get the area that changed since last call to updated()
+    /// @return rectangle in frame (parent view) coordinates that needs to be redrawn,
+    ///   zeroRect if nothing has changed
+    virtual PixelRect dirtyRect();
+
+    /// get the area this view can show non-transparent pixels in
+    /// @return rectangle in frame (parent view) coordinates
+    PixelRect getExtent();
+
+    /// get the area this view is guaranteed to show only fully opaque pixels in
+    /// @return rectangle in frame (parent view) coordinates, zeroRect if opacity cannot be guaranteed anywhere
+    PixelRect getOpaqueExtent();
+
     /// call when display is updated
-    virtual void updated() { dirty = false; };
+    virtual void updated();
 
   };
   typedef boost::intrusive_ptr<View> ViewPtr;
@@ -96,6 +96,7 @@ MLMicroSeconds ViewAnimator::stepAnimation()
         // initiate animation
         // - set current view
         currentView = as.view;
+        makeDirty();
         if (as.fadeInTime>0) {
           currentView->setAlpha(0);
           currentView->fadeTo(255, as.fadeInTime);
@@ -173,6 +174,22 @@ bool ViewAnimator::isDirty()
 }
 
 
+PixelRect ViewAnimator::dirtyRect()
+{
+  PixelRect r = inherited::dirtyRect();
+  if (currentView) {
+    r = unionRect(r, contentToFrameRect(currentView->dirtyRect()));
+  }
+  return r;
+}
+
+
+PixelRect ViewAnimator::contentExtent()
+{
+  return currentView ? currentView->getExtent() : zeroRect;
+}
+
+
 void ViewAnimator::updated()
 {
   inherited::updated();
@@ -191,3 +208,27 @@ PixelColor ViewAnimator::contentColorAt(int aX, int aY)
     return currentView->colorAt(aX, aY);
   }
 }
+
+
+void ViewAnimator::contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels)
+{
+  if (alpha==0 || !currentView) {
+    for (int i=0; i<aNumPixels; ++i) aPixels[i] = transparent;
+  }
+  else {
+    // consult current step's view
+    currentView->rowColorsAt(aX, aY, aNumPixels, aPixels);
+  }
+}
+
+
+void ViewAnimator::contentPremultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels)
+{
+  if (alpha==0 || !currentView) {
+    for (int i=0; i<aNumPixels; ++i) aPixels[i] = premultTransparent;
+  }
+  else {
+    // consult current step's view
+    currentView->premultipliedRowColorsAt(aX, aY, aNumPixels, aPixels);
+  }
+}
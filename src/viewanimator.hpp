@@ -88,6 +88,9 @@ namespace p44 {
     /// return if anything changed on the display since last call
     virtual bool isDirty() P44_OVERRIDE;
 
+    /// get the area that changed since last call to updated()
+    virtual PixelRect dirtyRect() P44_OVERRIDE;
+
     /// call when display is updated
     virtual void updated() P44_OVERRIDE;
 
@@ -100,6 +103,15 @@ namespace p44 {
     ///   implementation must check this!
     virtual PixelColor contentColorAt(int aX, int aY) P44_OVERRIDE;
 
+    /// get a horizontal run of content pixel colors
+    virtual void contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels) P44_OVERRIDE;
+
+    /// get a horizontal run of content pixel colors with premultiplied alpha
+    virtual void contentPremultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels) P44_OVERRIDE;
+
+    /// get the area where content can be non-transparent
+    virtual PixelRect contentExtent() P44_OVERRIDE;
+
   private:
 
     MLMicroSeconds stepAnimation();
@@ -34,7 +34,16 @@ ViewScroller::ViewScroller() :
   scrollStepY_milli(0),
   scrollSteps(0),
   scrollStepInterval(Never),
-  nextScrollStepAt(Never)
+  nextScrollStepAt(Never),
+  caughtUpSteps(0),
+  timedScroll(false),
+  scrollSpeedX_milli(0),
+  scrollSpeedY_milli(0),
+  scrollStartX_milli(0),
+  scrollStartY_milli(0),
+  scrollStartTime(Never),
+  scrollEndTime(Infinite),
+  stripRect(zeroRect)
 {
 }
 
@@ -56,6 +65,7 @@ void ViewScroller::clear()
 
 MLMicroSeconds ViewScroller::step()
 {
+  invalidateStrip(); // scrolled view or scroll offsets might change
   MLMicroSeconds nextCall = inherited::step();
   if (scrolledView) {
     MLMicroSeconds n = scrolledView->step();
@@ -64,7 +74,38 @@ MLMicroSeconds ViewScroller::step()
     }
   }
   // scroll
-  if (scrollSteps!=0 && scrollStepInterval>0) {
+  if (timedScroll && scrollSteps!=0) {
+    // time parametric scrolling: offsets are a function of time only, no catching up
+    MLMicroSeconds now = MainLoop::now();
+    MLMicroSeconds t = now;
+    bool ends = scrollEndTime!=Infinite && now>=scrollEndTime;
+    if (ends) t = scrollEndTime;
+    if (t<scrollStartTime) t = scrollStartTime; // not started yet
+    int64_t ox = scrollStartX_milli + (int64_t)scrollSpeedX_milli*(t-scrollStartTime)/Second;
+    int64_t oy = scrollStartY_milli + (int64_t)scrollSpeedY_milli*(t-scrollStartTime)/Second;
+    wrapOffsets(ox, oy);
+    if (ox!=scrollOffsetX_milli || oy!=scrollOffsetY_milli) {
+      scrollOffsetX_milli = (long)ox;
+      scrollOffsetY_milli = (long)oy;
+      makeDirty();
+    }
+    if (ends) {
+      // scroll ends here
+      scrollSteps = 0;
+      timedScroll = false;
+      if (scrollCompletedCB) {
+        SimpleCB cb = scrollCompletedCB;
+        scrollCompletedCB = NULL;
+        cb(); // may set up another scroll already
+      }
+    }
+    else {
+      MLMicroSeconds n = now<scrollStartTime ? scrollStartTime : now+scrollStepInterval;
+      if (scrollEndTime!=Infinite && n>scrollEndTime) n = scrollEndTime;
+      if (nextCall<0 || n<nextCall) nextCall = n;
+    }
+  }
+  else if (scrollSteps!=0 && scrollStepInterval>0) {
     // scrolling
     MLMicroSeconds now = MainLoop::now();
     MLMicroSeconds next = nextScrollStepAt-now; // time to next step
@@ -79,28 +120,13 @@ MLMicroSeconds ViewScroller::step()
           LOG(LOG_DEBUG, "ViewScroller: Warning: precision below 10mS: %lld uS after precise time", next);
         }
         // perform step
-        scrollOffsetX_milli += scrollStepX_milli;
-        scrollOffsetY_milli += scrollStepY_milli;
-        makeDirty();
+        int64_t ox = scrollOffsetX_milli+scrollStepX_milli;
+        int64_t oy = scrollOffsetY_milli+scrollStepY_milli;
         // limit coordinate increase in wraparound scroll view
-        // Note: might need multiple rounds after scrolled view's content size has changed to get back in range
-        if (scrolledView) {
-          WrapMode wm = scrolledView->getWrapMode();
-          if (wm&wrapX) {
-            long csx_milli = scrolledView->getContentSizeX()*1000;
-            while ((wm&wrapXmax) && scrollOffsetX_milli>=csx_milli && csx_milli>0)
-              scrollOffsetX_milli-=csx_milli;
-            while ((wm&wrapXmin) && scrollOffsetX_milli<0 && csx_milli>0)
-              scrollOffsetX_milli+=csx_milli;
-          }
-          if (wm&wrapY) {
-            long csy_milli = scrolledView->getContentSizeY()*1000;
-            while ((wm&wrapYmax) && scrollOffsetY_milli>=csy_milli && csy_milli>0)
-              scrollOffsetY_milli-=csy_milli;
-            while ((wm&wrapYmin) && scrollOffsetY_milli<0 && csy_milli>0)
-              scrollOffsetY_milli+=csy_milli;
-          }
-        }
+        wrapOffsets(ox, oy);
+        scrollOffsetX_milli = (long)ox;
+        scrollOffsetY_milli = (long)oy;
+        makeDirty();
         // check scroll end
         if (scrollSteps>0) {
           scrollSteps--;
@@ -119,6 +145,7 @@ MLMicroSeconds ViewScroller::step()
         nextScrollStepAt += scrollStepInterval;
         nextCall = nextScrollStepAt;
         if (next<0) {
+          caughtUpSteps++;
           LOG(LOG_INFO, "ViewScroller: needs to catch-up steps -> call step() more often!");
         }
       }
@@ -136,27 +163,82 @@ bool ViewScroller::isDirty()
 }
 
 
+PixelRect ViewScroller::scrolledToContentRect(const PixelRect &aRect)
+{
+  if (rectIsEmpty(aRect)) return zeroRect;
+  int sampleOffsetX, sampleOffsetY, subSampleOffsetX, subSampleOffsetY, outsideWeightX, outsideWeightY;
+  getSampling(sampleOffsetX, sampleOffsetY, subSampleOffsetX, subSampleOffsetY, outsideWeightX, outsideWeightY);
+  PixelRect r = aRect;
+  r.x -= sampleOffsetX;
+  r.y -= sampleOffsetY;
+  // subsampling mixes in neighbour pixels
+  if (outsideWeightX!=0) { r.x--; r.dx += 2; }
+  if (outsideWeightY!=0) { r.y--; r.dy += 2; }
+  return r;
+}
+
+
+PixelRect ViewScroller::dirtyRect()
+{
+  PixelRect r = inherited::dirtyRect();
+  if (scrolledView) {
+    r = unionRect(r, contentToFrameRect(scrolledToContentRect(scrolledView->dirtyRect())));
+  }
+  return r;
+}
+
+
+PixelRect ViewScroller::contentExtent()
+{
+  if (!scrolledView) return zeroRect;
+  return scrolledToContentRect(scrolledView->getExtent());
+}
+
+
 void ViewScroller::updated()
 {
   inherited::updated();
   if (scrolledView) scrolledView->updated();
+  invalidateStrip();
+}
+
+
+void ViewScroller::getSampling(int &aSampleOffsetX, int &aSampleOffsetY, int &aSubSampleOffsetX, int &aSubSampleOffsetY, int &aOutsideWeightX, int &aOutsideWeightY)
+{
+  // Note: implementation aims to be efficient at integer scroll offsets in either or both directions
+  aSampleOffsetX = (int)((scrollOffsetX_milli+(scrollOffsetX_milli>0 ? 500 : -500))/1000);
+  aSampleOffsetY = (int)((scrollOffsetY_milli+(scrollOffsetY_milli>0 ? 500 : -500))/1000);
+  aSubSampleOffsetX = 1;
+  aSubSampleOffsetY = 1;
+  aOutsideWeightX = (int)((scrollOffsetX_milli-(long)aSampleOffsetX*1000)*255/1000);
+  if (aOutsideWeightX<0) { aOutsideWeightX *= -1; aSubSampleOffsetX = -1; }
+  aOutsideWeightY = (int)((scrollOffsetY_milli-(long)aSampleOffsetY*1000)*255/1000);
+  if (aOutsideWeightY<0) { aOutsideWeightY *= -1; aSubSampleOffsetY = -1; }
 }
 
 
 PixelColor ViewScroller::contentColorAt(int aX, int aY)
 {
   if (!scrolledView) return transparent;
-  // Note: implementation aims to be efficient at integer scroll offsets in either or both directions
-  int sampleOffsetX = (int)((scrollOffsetX_milli+(scrollOffsetX_milli>0 ? 500 : -500))/1000);
-  int sampleOffsetY = (int)((scrollOffsetY_milli+(scrollOffsetY_milli>0 ? 500 : -500))/1000);
-  int subSampleOffsetX = 1;
-  int subSampleOffsetY = 1;
-  int outsideWeightX = (int)((scrollOffsetX_milli-(long)sampleOffsetX*1000)*255/1000);
-  if (outsideWeightX<0) { outsideWeightX *= -1; subSampleOffsetX = -1; }
-  int outsideWeightY = (int)((scrollOffsetY_milli-(long)sampleOffsetY*1000)*255/1000);
-  if (outsideWeightY<0) { outsideWeightY *= -1; subSampleOffsetY = -1; }
+  int sampleOffsetX, sampleOffsetY, subSampleOffsetX, subSampleOffsetY, outsideWeightX, outsideWeightY;
+  getSampling(sampleOffsetX, sampleOffsetY, subSampleOffsetX, subSampleOffsetY, outsideWeightX, outsideWeightY);
   sampleOffsetX += aX;
   sampleOffsetY += aY;
+  if (outsideWeightX!=0 || outsideWeightY!=0) {
+    // subsampling: use prerendered samples if possible
+    const PixelColor *mainSamples = stripSamples(sampleOffsetX-1, sampleOffsetY, 3);
+    const PixelColor *neighbourSamples = outsideWeightY!=0 ? stripSamples(sampleOffsetX-1, sampleOffsetY+subSampleOffsetY, 3) : NULL;
+    if (mainSamples && (outsideWeightY==0 || neighbourSamples)) {
+      PixelColor samp = mainSamples[1];
+      if (outsideWeightX!=0) mixinPixel(samp, mainSamples[1+subSampleOffsetX], outsideWeightX);
+      if (outsideWeightY!=0) {
+        PixelColor neighbourY = neighbourSamples[1];
+        if (outsideWeightX!=0) mixinPixel(neighbourY, neighbourSamples[1+subSampleOffsetX], outsideWeightX);
+        mixinPixel(samp, neighbourY, outsideWeightY);
+      }
+      return samp;
+    }
+  }
   PixelColor samp = scrolledView->colorAt(sampleOffsetX, sampleOffsetY);
   if (outsideWeightX!=0) {
     // X Subsampling (and possibly also Y, checked below)
@@ -178,6 +260,109 @@ PixelColor ViewScroller::contentColorAt(int aX, int aY)
 }
 
 
+void ViewScroller::contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels)
+{
+  if (!scrolledView) {
+    for (int i=0; i<aNumPixels; ++i) aPixels[i] = transparent;
+    return;
+  }
+  int sampleOffsetX, sampleOffsetY, subSampleOffsetX, subSampleOffsetY, outsideWeightX, outsideWeightY;
+  getSampling(sampleOffsetX, sampleOffsetY, subSampleOffsetX, subSampleOffsetY, outsideWeightX, outsideWeightY);
+  sampleOffsetX += aX;
+  sampleOffsetY += aY;
+  if (outsideWeightY!=0) {
+    // Y subsampling: use prerendered samples if possible, so every scrolled view row is rendered once
+    // per frame, instead of once for each of the two output rows it contributes to
+    // Note: X-only subsampling renders every scrolled view row once anyway
+    const PixelColor *mainRow = stripSamples(sampleOffsetX-1, sampleOffsetY, aNumPixels+2);
+    const PixelColor *neighbourRow = stripSamples(sampleOffsetX-1, sampleOffsetY+subSampleOffsetY, aNumPixels+2);
+    if (mainRow && neighbourRow) {
+      mainRow++; // skip margin
+      std::copy(mainRow, mainRow+aNumPixels, aPixels);
+      if (outsideWeightX!=0) {
+        mixinPixels(aPixels, mainRow+subSampleOffsetX, aNumPixels, outsideWeightX);
+      }
+      neighbourRow++; // skip margin
+      if (outsideWeightX!=0) {
+        rowBuffer.resize(aNumPixels);
+        PixelColor *neighbourMix = &rowBuffer[0];
+        std::copy(neighbourRow, neighbourRow+aNumPixels, neighbourMix);
+        mixinPixels(neighbourMix, neighbourRow+subSampleOffsetX, aNumPixels, outsideWeightX);
+        neighbourRow = neighbourMix;
+      }
+      mixinPixels(aPixels, neighbourRow, aNumPixels, outsideWeightY);
+      return;
+    }
+  }
+  // render scrolled view rows directly
+  if (outsideWeightX==0) {
+    // no X subsampling, main row can be rendered directly into result
+    scrolledView->rowColorsAt(sampleOffsetX, sampleOffsetY, aNumPixels, aPixels);
+    if (outsideWeightY!=0) {
+      // only Y subsampling
+      rowBuffer.resize(aNumPixels);
+      scrolledView->rowColorsAt(sampleOffsetX, sampleOffsetY+subSampleOffsetY, aNumPixels, &rowBuffer[0]);
+      mixinPixels(aPixels, &rowBuffer[0], aNumPixels, outsideWeightY);
+    }
+  }
+  else {
+    // X Subsampling: rows need one extra pixel on the subsampling side
+    int mainIdx = subSampleOffsetX<0 ? 1 : 0; // index of main sample in row buffers
+    int rowLen = aNumPixels+1;
+    // Note: mixing must not happen in place in the row buffers, as the X neighbours overlap
+    rowBuffer.resize(outsideWeightY!=0 ? 3*rowLen : rowLen);
+    PixelColor *mainRow = &rowBuffer[0];
+    scrolledView->rowColorsAt(sampleOffsetX-mainIdx, sampleOffsetY, rowLen, mainRow);
+    std::copy(mainRow+mainIdx, mainRow+mainIdx+aNumPixels, aPixels);
+    mixinPixels(aPixels, mainRow+mainIdx+subSampleOffsetX, aNumPixels, outsideWeightX);
+    if (outsideWeightY!=0) {
+      // also need the Y side neighbour row
+      PixelColor *neighbourRow = &rowBuffer[rowLen];
+      PixelColor *neighbourMix = &rowBuffer[2*rowLen];
+      scrolledView->rowColorsAt(sampleOffsetX-mainIdx, sampleOffsetY+subSampleOffsetY, rowLen, neighbourRow);
+      std::copy(neighbourRow+mainIdx, neighbourRow+mainIdx+aNumPixels, neighbourMix);
+      mixinPixels(neighbourMix, neighbourRow+mainIdx+subSampleOffsetX, aNumPixels, outsideWeightX);
+      mixinPixels(aPixels, neighbourMix, aNumPixels, outsideWeightY);
+    }
+  }
+}
+
+
+const PixelColor *ViewScroller::stripSamples(int aX, int aY, int aNumPixels)
+{
+  if (rectIsEmpty(stripRect)) {
+    // set up strip for the visible window in content coordinates
+    int x0 = tXX*originX + tXY*originY + tX;
+    int y0 = tYX*originX + tYY*originY + tY;
+    int x1 = tXX*(originX+dX-1) + tXY*(originY+dY-1) + tX;
+    int y1 = tYX*(originX+dX-1) + tYY*(originY+dY-1) + tY;
+    int sampleOffsetX, sampleOffsetY, subSampleOffsetX, subSampleOffsetY, outsideWeightX, outsideWeightY;
+    getSampling(sampleOffsetX, sampleOffsetY, subSampleOffsetX, subSampleOffsetY, outsideWeightX, outsideWeightY);
+    // - in scrolled view coordinates, with one pixel margin on all sides for subsampling
+    stripRect.x = min(x0, x1)+sampleOffsetX-1;
+    stripRect.y = min(y0, y1)+sampleOffsetY-1;
+    stripRect.dx = abs(x1-x0)+3;
+    stripRect.dy = abs(y1-y0)+3;
+    if (dX<=0 || dY<=0) stripRect = zeroRect;
+    strip.resize(stripRect.dx*stripRect.dy);
+    stripRowValid.assign(stripRect.dy, false);
+  }
+  if (
+    aY<stripRect.y || aY>=stripRect.y+stripRect.dy ||
+    aX<stripRect.x || aX+aNumPixels>stripRect.x+stripRect.dx
+  ) {
+    return NULL; // not within visible window
+  }
+  int row = aY-stripRect.y;
+  PixelColor *rowPixels = &strip[row*stripRect.dx];
+  if (!stripRowValid[row]) {
+    scrolledView->rowColorsAt(stripRect.x, aY, stripRect.dx, rowPixels);
+    stripRowValid[row] = true;
+  }
+  return rowPixels+aX-stripRect.x;
+}
+
+
 void ViewScroller::startScroll(double aStepX, double aStepY, MLMicroSeconds aInterval, bool aRoundOffsets, long aNumSteps, MLMicroSeconds aStartTime, SimpleCB aCompletedCB)
 {
   scrollStepX_milli = aStepX*1000;
@@ -188,6 +373,7 @@ void ViewScroller::startScroll(double aStepX, double aStepY, MLMicroSeconds aInt
   }
   scrollStepInterval = aInterval;
   scrollSteps = aNumSteps;
+  timedScroll = false;
   MLMicroSeconds now = MainLoop::now();
   // do not allow setting scroll step into the past, as this would cause massive catch-up
   nextScrollStepAt = aStartTime==Never || aStartTime<now ? now : aStartTime;
@@ -195,9 +381,77 @@ void ViewScroller::startScroll(double aStepX, double aStepY, MLMicroSeconds aInt
 }
 
 
+void ViewScroller::startTimedScroll(double aSpeedX, double aSpeedY, MLMicroSeconds aFrameInterval, MLMicroSeconds aDuration, MLMicroSeconds aStartTime, SimpleCB aCompletedCB)
+{
+  scrollSpeedX_milli = aSpeedX*1000;
+  scrollSpeedY_milli = aSpeedY*1000;
+  scrollStartX_milli = scrollOffsetX_milli;
+  scrollStartY_milli = scrollOffsetY_milli;
+  scrollStartTime = aStartTime==Never ? MainLoop::now() : aStartTime;
+  scrollEndTime = aDuration==Infinite ? Infinite : scrollStartTime+aDuration;
+  // equivalent steps, for reporting
+  scrollStepInterval = aFrameInterval;
+  scrollStepX_milli = (int64_t)scrollSpeedX_milli*aFrameInterval/Second;
+  scrollStepY_milli = (int64_t)scrollSpeedY_milli*aFrameInterval/Second;
+  scrollSteps = -1; // running until scrollEndTime
+  timedScroll = true;
+  scrollCompletedCB = aCompletedCB;
+}
+
+
 void ViewScroller::stopScroll()
 {
   // no more steps
   scrollSteps = 0;
+  timedScroll = false;
+}
+
+
+void ViewScroller::setOffsetX(double aOffsetX)
+{
+  long ox = aOffsetX*1000l;
+  if (ox==scrollOffsetX_milli) return; // no change, no need to render again
+  scrollStartX_milli += ox-scrollOffsetX_milli; // timed scroll continues from here
+  scrollOffsetX_milli = ox;
+  invalidateStrip();
+  makeDirty();
+}
+
+
+void ViewScroller::setOffsetY(double aOffsetY)
+{
+  long oy = aOffsetY*1000l;
+  if (oy==scrollOffsetY_milli) return; // no change, no need to render again
+  scrollStartY_milli += oy-scrollOffsetY_milli; // timed scroll continues from here
+  scrollOffsetY_milli = oy;
+  invalidateStrip();
+  makeDirty();
+}
+
+
+static int64_t wrapOffset(int64_t aOffset_milli, int64_t aSize_milli, bool aWrapMin, bool aWrapMax)
+{
+  if (aSize_milli<=0) return aOffset_milli;
+  if (aWrapMax && aOffset_milli>=aSize_milli) {
+    aOffset_milli %= aSize_milli;
+  }
+  else if (aWrapMin && aOffset_milli<0) {
+    aOffset_milli %= aSize_milli;
+    if (aOffset_milli<0) aOffset_milli += aSize_milli;
+  }
+  return aOffset_milli;
+}
+
+
+void ViewScroller::wrapOffsets(int64_t &aOffsetX_milli, int64_t &aOffsetY_milli)
+{
+  if (!scrolledView) return;
+  WrapMode wm = scrolledView->getWrapMode();
+  if (wm&wrapX) {
+    aOffsetX_milli = wrapOffset(aOffsetX_milli, (int64_t)scrolledView->getContentSizeX()*1000, wm&wrapXmin, wm&wrapXmax);
+  }
+  if (wm&wrapY) {
+    aOffsetY_milli = wrapOffset(aOffsetY_milli, (int64_t)scrolledView->getContentSizeY()*1000, wm&wrapYmin, wm&wrapYmax);
+  }
 }
 
@@ -46,6 +46,24 @@ namespace p44 {
     MLMicroSeconds scrollStepInterval; ///< interval between scroll steps
     MLMicroSeconds nextScrollStepAt; ///< exact time when next step should occur
     SimpleCB scrollCompletedCB; ///< called when one scroll is done
+    long caughtUpSteps; ///< number of scroll steps that were executed late, together with the previous step
+
+    // time parametric scroll animation
+    bool timedScroll; ///< if set, scroll offsets are calculated from time rather than advanced in steps
+    long scrollSpeedX_milli; ///< in millipixel per second, X scroll speed
+    long scrollSpeedY_milli; ///< in millipixel per second, Y scroll speed
+    long scrollStartX_milli; ///< in millipixel, X scroll offset at scrollStartTime
+    long scrollStartY_milli; ///< in millipixel, Y scroll offset at scrollStartTime
+    MLMicroSeconds scrollStartTime; ///< time when scroll offsets were scrollStartX/Y_milli
+    MLMicroSeconds scrollEndTime; ///< time when timed scroll ends, Infinite for scrolling forever
+
+    // row rendering
+    std::vector<PixelColor> rowBuffer; ///< buffer for rendering rows of the scrolled view
+
+    // prerendered samples of the scrolled view for subpixel sampling, valid for one frame
+    std::vector<PixelColor> strip; ///< scrolled view pixels covering the visible window plus a one pixel margin
+    PixelRect stripRect; ///< area of the scrolled view (in its frame coordinates) covered by strip, zeroRect when invalid
+    std::vector<bool> stripRowValid; ///< set for rows of strip already rendered in this frame
 
   protected:
 
@@ -56,6 +74,12 @@ namespace p44 {
     ///   implementation must check this!
     virtual PixelColor contentColorAt(int aX, int aY) P44_OVERRIDE;
 
+    /// get a horizontal run of content pixel colors
+    virtual void contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels) P44_OVERRIDE;
+
+    /// get the area where content can be non-transparent
+    virtual PixelRect contentExtent() P44_OVERRIDE;
+
   public :
 
     /// create view
@@ -65,7 +89,7 @@ namespace p44 {
 
     /// set the to be scrolled view
     /// @param aScrolledView the view of which a part should be shown in this view.
-    void setScrolledView(ViewPtr aScrolledView) { scrolledView = aScrolledView; makeDirty(); }
+    void setScrolledView(ViewPtr aScrolledView) { scrolledView = aScrolledView; invalidateStrip(); makeDirty(); }
 
     /// @return the view being scrolled
     ViewPtr getScrolledView() { return scrolledView; }
@@ -74,13 +98,15 @@ namespace p44 {
     /// @param aOffsetX X direction scroll offset, subpixel distances allowed
     /// @note the scroll offset describes the distance from this view's content origin (not its origin on the parent view!)
     ///   to the scrolled view's origin (not its content origin)
-    void setOffsetX(double aOffsetX) { scrollOffsetX_milli = aOffsetX*1000l; makeDirty(); }
+    /// @note during a timed scroll, the scroll continues from the new offset
+    void setOffsetX(double aOffsetX);
 
     /// set scroll offsets
     /// @param aOffsetY Y direction scroll offset, subpixel distances allowed
     /// @note the scroll offset describes the distance from this view's content origin (not its origin on the parent view!)
     ///   to the scrolled view's origin (not its content origin)
-    void setOffsetY(double aOffsetY) { scrollOffsetY_milli = aOffsetY*1000l; makeDirty(); }
+    /// @note during a timed scroll, the scroll continues from the new offset
+    void setOffsetY(double aOffsetY);
 
     /// @return the current X scroll offset
     double getOffsetX() const { return (double)scrollOffsetX_milli/1000; };
@@ -102,6 +128,20 @@ namespace p44 {
     ///   and MainLoop::unixTimeToMainLoopTime() to convert a absolute starting point into now() time.
     void startScroll(double aStepX, double aStepY, MLMicroSeconds aInterval, bool aRoundOffsets = true, long aNumSteps = -1, MLMicroSeconds aStartTime = Never, SimpleCB aCompletedCB = NULL);
 
+    /// start time parametric scrolling
+    /// @param aSpeedX scroll speed in X direction in pixels per second
+    /// @param aSpeedY scroll speed in Y direction in pixels per second
+    /// @param aFrameInterval how often step() wants to be called to render a new frame while scrolling
+    /// @param aDuration how long to scroll, Infinite = forever (until stopScroll() is called)
+    /// @param aStartTime time in MainLoop::now() timescale when the scroll offsets had their current values.
+    ///   If ==Never, then now() is used. Unlike with startScroll(), this can be in the past.
+    /// @param aCompletedCB called when scroll ends because aDuration has passed (but not when aborted via stopScroll())
+    /// @note unlike startScroll(), the scroll offsets are not advanced step by step, but calculated from
+    ///   aStartTime, the speed and the current time at every step(). So the scroll position does not depend
+    ///   on how often step() is called, a late step() does not need to catch up, and multiple devices
+    ///   starting with the same offsets at the same aStartTime remain exactly in phase.
+    void startTimedScroll(double aSpeedX, double aSpeedY, MLMicroSeconds aFrameInterval, MLMicroSeconds aDuration = Infinite, MLMicroSeconds aStartTime = Never, SimpleCB aCompletedCB = NULL);
+
     /// stop scrolling
     /// @note: completed callback will not be called
     void stopScroll();
@@ -115,6 +155,10 @@ namespace p44 {
     /// @return the time interval between two scroll steps
     MLMicroSeconds getScrollStepInterval() const { return scrollStepInterval; }
 
+    /// @return total number of scroll steps so far that could not be executed in time, and
+    ///   were executed later together with the previous step
+    long getCaughtUpSteps() const { return caughtUpSteps; }
+
     /// clear contents of this view
     virtual void clear() P44_OVERRIDE;
 
@@ -126,9 +170,34 @@ namespace p44 {
     /// return if anything changed on the display since last call
     virtual bool isDirty() P44_OVERRIDE;
 
+    /// get the area that changed since last call to updated()
+    virtual PixelRect dirtyRect() P44_OVERRIDE;
+
     /// call when display is updated
     virtual void updated() P44_OVERRIDE;
 
+  private:
+
+    /// bring scroll offsets back into range of the scrolled view's content size for wraparound scrolled views
+    /// @param aOffsetX_milli,aOffsetY_milli scroll offsets in millipixel, wrapped in place in O(1)
+    void wrapOffsets(int64_t &aOffsetX_milli, int64_t &aOffsetY_milli);
+
+    /// calculate integer sample offsets and subpixel weights from current scroll offsets
+    void getSampling(int &aSampleOffsetX, int &aSampleOffsetY, int &aSubSampleOffsetX, int &aSubSampleOffsetY, int &aOutsideWeightX, int &aOutsideWeightY);
+
+    /// transform a rectangle in scrolled view's frame coordinates into this view's content coordinates
+    PixelRect scrolledToContentRect(const PixelRect &aRect);
+
+    /// forget prerendered samples
+    /// @note called whenever scroll offsets or the scrolled view might have changed, i.e. at every step() and updated()
+    void invalidateStrip() { stripRect = zeroRect; }
+
+    /// get prerendered samples of the scrolled view, rendering them on first use in a frame
+    /// @param aX,aY scrolled view frame coordinates of the first sample
+    /// @param aNumPixels number of samples needed
+    /// @return pointer to the samples, NULL if these are not within the visible window (plus margin)
+    const PixelColor *stripSamples(int aX, int aY, int aNumPixels);
+
   };
   typedef boost::intrusive_ptr<ViewScroller> ViewScrollerPtr;
 
@@ -26,7 +26,8 @@ using namespace p44;
 
 // MARK: ===== ViewStack
 
-ViewStack::ViewStack()
+ViewStack::ViewStack() :
+  layersValid(false)
 {
 }
 
@@ -36,34 +37,118 @@ ViewStack::~ViewStack()
 }
 
 
-void ViewStack::pushView(ViewPtr aView)
+int ViewStack::pushView(ViewPtr aView)
 {
-  viewStack.push_back(aView);
+  return insertView(aView, (int)viewStack.size());
+}
+
+
+int ViewStack::insertView(ViewPtr aView, int aZ)
+{
+  // find a free layer id
+  int id = 0;
+  while (id<(int)layerIndices.size() && layerIndices[id]>=0) id++;
+  if (id>=(int)layerIndices.size()) layerIndices.push_back(-1);
+  // insert
+  size_t idx = aZ<0 ? 0 : min((size_t)aZ, viewStack.size());
+  Layer layer;
+  layer.view = aView;
+  layer.id = id;
+  viewStack.insert(viewStack.begin()+idx, layer);
+  reindexLayers(idx);
+  layersValid = false;
   makeDirty();
+  return id;
 }
 
 
 void ViewStack::popView()
 {
+  if (viewStack.empty()) return;
+  layerIndices[viewStack.back().id] = -1;
   viewStack.pop_back();
+  layersValid = false;
   makeDirty();
 }
 
 
 void ViewStack::removeView(ViewPtr aView)
 {
-  for (ViewsList::iterator pos = viewStack.begin(); pos!=viewStack.end(); ++pos) {
-    if ((*pos)==aView) {
-      viewStack.erase(pos);
+  for (LayersVector::iterator pos = viewStack.begin(); pos!=viewStack.end(); ++pos) {
+    if (pos->view==aView) {
+      removeLayer(pos->id);
       break;
     }
   }
 }
 
 
+void ViewStack::removeLayer(int aLayerId)
+{
+  int idx = layerIndex(aLayerId);
+  if (idx<0) return;
+  layerIndices[aLayerId] = -1;
+  viewStack.erase(viewStack.begin()+idx);
+  reindexLayers(idx);
+  layersValid = false;
+  makeDirty();
+}
+
+
+void ViewStack::moveLayer(int aLayerId, int aZ)
+{
+  int idx = layerIndex(aLayerId);
+  if (idx<0) return;
+  int newIdx = aZ<0 ? 0 : min(aZ, (int)viewStack.size()-1);
+  if (newIdx==idx) return;
+  // rotate the layer into its new position, shifting the ones in between by one
+  if (newIdx<idx) {
+    std::rotate(viewStack.begin()+newIdx, viewStack.begin()+idx, viewStack.begin()+idx+1);
+    reindexLayers(newIdx);
+  }
+  else {
+    std::rotate(viewStack.begin()+idx, viewStack.begin()+idx+1, viewStack.begin()+newIdx+1);
+    reindexLayers(idx);
+  }
+  layersValid = false;
+  makeDirty();
+}
+
+
+ViewPtr ViewStack::getLayer(int aLayerId)
+{
+  int idx = layerIndex(aLayerId);
+  if (idx<0) return ViewPtr();
+  return viewStack[idx].view;
+}
+
+
+int ViewStack::getLayerZ(int aLayerId)
+{
+  return layerIndex(aLayerId);
+}
+
+
+int ViewStack::layerIndex(int aLayerId)
+{
+  if (aLayerId<0 || aLayerId>=(int)layerIndices.size()) return -1;
+  return layerIndices[aLayerId];
+}
+
+
+void ViewStack::reindexLayers(size_t aFromIndex)
+{
+  for (size_t i=aFromIndex; i<viewStack.size(); ++i) {
+    layerIndices[viewStack[i].id] = (int)i;
+  }
+}
+
+
 void ViewStack::clear()
 {
   viewStack.clear();
+  layerIndices.clear();
+  layersValid = false;
   inherited::clear();
 }
 
@@ -71,12 +156,13 @@ void ViewStack::clear()
 MLMicroSeconds ViewStack::step()
 {
   MLMicroSeconds nextCall = inherited::step();
-  for (ViewsList::iterator pos = viewStack.begin(); pos!=viewStack.end(); ++pos) {
-    MLMicroSeconds n = (*pos)->step();
+  for (LayersVector::iterator pos = viewStack.begin(); pos!=viewStack.end(); ++pos) {
+    MLMicroSeconds n = pos->view->step();
     if (nextCall<0 || (n>0 && n<nextCall)) {
       nextCall = n;
     }
   }
+  layersValid = false; // layers might have moved, faded etc.
   return nextCall;
 }
 
@@ -84,20 +170,91 @@ MLMicroSeconds ViewStack::step()
 bool ViewStack::isDirty()
 {
   if (inherited::isDirty()) return true; // dirty anyway
-  for (ViewsList::iterator pos = viewStack.begin(); pos!=viewStack.end(); ++pos) {
-    if ((*pos)->isDirty())
+  for (LayersVector::iterator pos = viewStack.begin(); pos!=viewStack.end(); ++pos) {
+    if (pos->view->isDirty())
       return true; // subview is dirty -> stack is dirty
   }
   return false;
 }
 
 
+PixelRect ViewStack::dirtyRect()
+{
+  PixelRect r = inherited::dirtyRect();
+  PixelRect lr = zeroRect;
+  for (LayersVector::iterator pos = viewStack.begin(); pos!=viewStack.end(); ++pos) {
+    lr = unionRect(lr, pos->view->dirtyRect());
+  }
+  return unionRect(r, contentToFrameRect(lr));
+}
+
+
+PixelRect ViewStack::contentExtent()
+{
+  // layers are composited onto opaque black, so stack content is never transparent
+  return infiniteRect;
+}
+
+
 void ViewStack::updated()
 {
   inherited::updated();
-  for (ViewsList::iterator pos = viewStack.begin(); pos!=viewStack.end(); ++pos) {
-    (*pos)->updated();
+  for (LayersVector::iterator pos = viewStack.begin(); pos!=viewStack.end(); ++pos) {
+    pos->view->updated();
   }
+  layersValid = false;
+}
+
+
+static bool rectContains(const PixelRect &aOuter, const PixelRect &aInner)
+{
+  return
+    aInner.x>=aOuter.x && aInner.x+aInner.dx<=aOuter.x+aOuter.dx &&
+    aInner.y>=aOuter.y && aInner.y+aInner.dy<=aOuter.y+aOuter.dy;
+}
+
+
+void ViewStack::prepareLayers()
+{
+  if (layersValid) return;
+  layers.clear();
+  for (LayersVector::reverse_iterator pos = viewStack.rbegin(); pos!=viewStack.rend(); ++pos) {
+    LayerInfo l;
+    l.view = pos->view.get();
+    if (l.view->alpha==0) continue; // fully transparent layer
+    l.extent = l.view->getExtent();
+    if (rectIsEmpty(l.extent)) continue; // nothing to show
+    bool hidden = false;
+    for (size_t i=0; i<layers.size(); ++i) {
+      if (rectContains(layers[i].opaqueExtent, l.extent)) {
+        hidden = true; // entirely behind an opaque layer
+        break;
+      }
+    }
+    if (hidden) continue;
+    l.opaqueExtent = l.view->getOpaqueExtent();
+    layers.push_back(l);
+  }
+  layersValid = true;
+}
+
+
+bool ViewStack::layerRowRange(const LayerInfo &aLayer, size_t aLayerIndex, int aX, int aY, int aNumPixels, int &aStart, int &aEnd)
+{
+  const PixelRect &e = aLayer.extent;
+  if (aY<e.y || aY>=e.y+e.dy) return false;
+  aStart = max(e.x-aX, 0);
+  aEnd = min(e.x+e.dx-aX, aNumPixels);
+  // cut away ends of the range hidden by opaque layers above
+  for (size_t i=0; i<aLayerIndex && aStart<aEnd; ++i) {
+    const PixelRect &o = layers[i].opaqueExtent;
+    if (aY<o.y || aY>=o.y+o.dy) continue;
+    int oStart = o.x-aX;
+    int oEnd = o.x+o.dx-aX;
+    if (oStart<=aStart && oEnd>aStart) aStart = oEnd;
+    if (oEnd>=aEnd && oStart<aEnd) aEnd = oStart;
+  }
+  return aStart<aEnd;
 }
 
 
@@ -112,10 +269,11 @@ PixelColor ViewStack::contentColorAt(int aX, int aY)
     PixelColor pc = black;
     PixelColor lc;
     uint8_t seethrough = 255; // first layer is directly visible, not yet obscured
-    for (ViewsList::reverse_iterator pos = viewStack.rbegin(); pos!=viewStack.rend(); ++pos) {
-      ViewPtr layer = *pos;
-      if (layer->alpha==0) continue; // shortcut: skip fully transparent layers
-      lc = layer->colorAt(aX, aY);
+    prepareLayers();
+    for (size_t l=0; l<layers.size(); ++l) {
+      const PixelRect &e = layers[l].extent;
+      if (aX<e.x || aX>=e.x+e.dx || aY<e.y || aY>=e.y+e.dy) continue; // layer has nothing to show here
+      lc = layers[l].view->colorAt(aX, aY);
       if (lc.a==0) continue; // skip layer with fully transparent pixel
       // not-fully-transparent pixel
       // - scale down to current budget left
@@ -138,3 +296,105 @@ PixelColor ViewStack::contentColorAt(int aX, int aY)
     return pc;
   }
 }
+
+
+void ViewStack::contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels)
+{
+  if (alpha==0) {
+    // entire viewstack is invisible
+    for (int i=0; i<aNumPixels; ++i) aPixels[i] = transparent;
+    return;
+  }
+  // same compositing as contentColorAt(), but layer by layer for the entire row
+  layerRow.resize(aNumPixels);
+  rowSeethrough.assign(aNumPixels, 255); // first layer is directly visible, not yet obscured
+  for (int i=0; i<aNumPixels; ++i) aPixels[i] = black;
+  int open = aNumPixels; // number of pixels not yet fully obscured
+  PixelColor lc;
+  prepareLayers();
+  for (size_t l=0; l<layers.size() && open>0; ++l) {
+    // only render the part of the row the layer can contribute to
+    int start, end;
+    if (!layerRowRange(layers[l], l, aX, aY, aNumPixels, start, end)) continue;
+    layers[l].view->rowColorsAt(aX+start, aY, end-start, &layerRow[start]);
+    // - scale down alpha to current budget left
+    //   Note: this also yields zero alpha for pixels already obscured or fully transparent in this layer,
+    //   so these can go through the same row operations below without any effect
+    for (int i=start; i<end; ++i) {
+      uint8_t &seethrough = rowSeethrough[i];
+      uint8_t a = dimVal(layerRow[i].a, seethrough);
+      layerRow[i].a = a;
+      if (a>0) {
+        seethrough -= a;
+        if (seethrough==0) open--;
+      }
+    }
+    // - add layer, reduced by its alpha
+    alphaDimPixels(&layerRow[start], end-start);
+    addToPixels(aPixels+start, &layerRow[start], end-start);
+  } // collect from all layers
+  for (int i=0; i<aNumPixels; ++i) {
+    PixelColor &pc = aPixels[i];
+    if (rowSeethrough[i]>0) {
+      // rest is background
+      lc.a = dimVal(backgroundColor.a, rowSeethrough[i]);
+      lc = dimmedPixel(backgroundColor, lc.a);
+      addToPixel(pc, lc);
+    }
+    // factor in alpha of entire viewstack
+    if (alpha!=255) {
+      pc.a = dimVal(pc.a, alpha);
+    }
+  }
+}
+
+
+void ViewStack::contentPremultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels)
+{
+  if (alpha==0) {
+    // entire viewstack is invisible
+    for (int i=0; i<aNumPixels; ++i) aPixels[i] = premultTransparent;
+    return;
+  }
+  // same compositing as contentRowColorsAt(), but layers deliver colors already reduced by their alpha,
+  // so only pixels partially obscured by layers above need scaling
+  premultLayerRow.resize(aNumPixels);
+  rowSeethrough.assign(aNumPixels, 255); // first layer is directly visible, not yet obscured
+  for (int i=0; i<aNumPixels; ++i) aPixels[i] = premultBlack;
+  int open = aNumPixels; // number of pixels not yet fully obscured
+  prepareLayers();
+  for (size_t l=0; l<layers.size() && open>0; ++l) {
+    // only render the part of the row the layer can contribute to
+    int start, end;
+    if (!layerRowRange(layers[l], l, aX, aY, aNumPixels, start, end)) continue;
+    layers[l].view->premultipliedRowColorsAt(aX+start, aY, end-start, &premultLayerRow[start]);
+    for (int i=start; i<end; ++i) {
+      uint8_t &seethrough = rowSeethrough[i];
+      PremultPixelColor lc = premultLayerRow[i];
+      if (seethrough==0 || lc.a==0) continue; // obscured, or transparent layer pixel
+      if (seethrough!=255) {
+        // - scale down to current budget left
+        scalePremultipliedPixel(lc, seethrough);
+      }
+      addToPixel(aPixels[i], lc);
+      seethrough -= lc.a;
+      if (seethrough==0) open--;
+    }
+  } // collect from all layers
+  if (open>0) {
+    // rest is background
+    PremultPixelColor bg = premultipliedPixel(backgroundColor);
+    for (int i=0; i<aNumPixels; ++i) {
+      uint8_t seethrough = rowSeethrough[i];
+      if (seethrough>0) {
+        PremultPixelColor lc = bg;
+        scalePremultipliedPixel(lc, seethrough); // alpha is not used for adding
+        addToPixel(aPixels[i], lc);
+      }
+    }
+  }
+  // factor in alpha of entire viewstack
+  if (alpha!=255) {
+    scalePremultipliedPixels(aPixels, aNumPixels, alpha);
+  }
+}
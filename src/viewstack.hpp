@@ -30,9 +30,29 @@ namespace p44 {
   {
     typedef View inherited;
 
-    typedef std::list<ViewPtr> ViewsList;
-
-    ViewsList viewStack;
+    /// a layer of the stack
+    typedef struct {
+      ViewPtr view;
+      int id; ///< layer id, stays the same when the layer is moved in the stack
+    } Layer;
+    typedef std::vector<Layer> LayersVector;
+
+    LayersVector viewStack; ///< layers in z-order, bottommost first
+    std::vector<int> layerIndices; ///< index into viewStack by layer id, -1 for unused ids
+
+    /// layer information, evaluated once per frame to skip layers that cannot contribute to a pixel
+    typedef struct {
+      View *view; ///< the layer (retained by viewStack)
+      PixelRect extent; ///< area where the layer can show non-transparent pixels
+      PixelRect opaqueExtent; ///< area where the layer hides everything behind it
+    } LayerInfo;
+    std::vector<LayerInfo> layers; ///< visible layers, topmost first
+    bool layersValid; ///< set when layers reflects current state of the views in the stack
+
+    // row rendering
+    std::vector<PixelColor> layerRow; ///< buffer for rendering a row of a layer
+    std::vector<PremultPixelColor> premultLayerRow; ///< buffer for rendering a row of a layer with premultiplied alpha
+    std::vector<uint8_t> rowSeethrough; ///< per pixel seethrough left while compositing a row
 
   public :
 
@@ -43,15 +63,44 @@ namespace p44 {
 
     /// push view onto top of stack
     /// @param aView the view to push in front of all other views
-    void pushView(ViewPtr aView);
+    /// @return layer id of the new layer
+    int pushView(ViewPtr aView);
+
+    /// insert view at a given z position
+    /// @param aView the view to insert
+    /// @param aZ z position, 0=bottommost. Existing layers at aZ and above move one up.
+    ///   Values beyond the top of the stack put the view on top.
+    /// @return layer id of the new layer
+    int insertView(ViewPtr aView, int aZ);
 
     /// remove topmost view
     void popView();
 
     /// remove specific view
     /// @param aView the view to remove from the stack
+    /// @note searches the stack, use removeLayer() when the layer id is known
     void removeView(ViewPtr aView);
 
+    /// remove a layer
+    /// @param aLayerId id of the layer as returned by pushView() or insertView()
+    void removeLayer(int aLayerId);
+
+    /// move a layer to a different z position
+    /// @param aLayerId id of the layer
+    /// @param aZ new z position, 0=bottommost, values beyond the top move the layer to the top
+    void moveLayer(int aLayerId, int aZ);
+
+    /// @param aLayerId id of the layer
+    /// @return the layer's view, NULL if no such layer
+    ViewPtr getLayer(int aLayerId);
+
+    /// @param aLayerId id of the layer
+    /// @return z position of the layer, 0=bottommost, -1 if no such layer
+    int getLayerZ(int aLayerId);
+
+    /// @return number of layers in the stack
+    int numLayers() { return (int)viewStack.size(); }
+
 
     /// clear stack, means remove all views
     virtual void clear() P44_OVERRIDE;
@@ -64,6 +113,9 @@ namespace p44 {
     /// return if anything changed on the display since last call
     virtual bool isDirty() P44_OVERRIDE;
 
+    /// get the area that changed since last call to updated()
+    virtual PixelRect dirtyRect() P44_OVERRIDE;
+
     /// call when display is updated
     virtual void updated() P44_OVERRIDE;
 
@@ -76,6 +128,38 @@ namespace p44 {
     ///   implementation must check this!
     virtual PixelColor contentColorAt(int aX, int aY) P44_OVERRIDE;
 
+    /// get a horizontal run of content pixel colors
+    virtual void contentRowColorsAt(int aX, int aY, int aNumPixels, PixelColor *aPixels) P44_OVERRIDE;
+
+    /// get a horizontal run of content pixel colors with premultiplied alpha
+    virtual void contentPremultipliedRowColorsAt(int aX, int aY, int aNumPixels, PremultPixelColor *aPixels) P44_OVERRIDE;
+
+    /// get the area where content can be non-transparent
+    virtual PixelRect contentExtent() P44_OVERRIDE;
+
+    /// @return true, layers are composited onto opaque black
+    virtual bool contentIsOpaque() P44_OVERRIDE { return true; }
+
+  private:
+
+    /// @return index into viewStack for aLayerId, -1 if no such layer
+    int layerIndex(int aLayerId);
+
+    /// update layerIndices for layers from aFromIndex to the top of the stack
+    void reindexLayers(size_t aFromIndex);
+
+    /// update layers if needed
+    /// @note layers are re-evaluated after step() and updated(), and after changes to the stack itself
+    void prepareLayers();
+
+    /// determine range of a row to be rendered from a layer
+    /// @param aLayer layer info
+    /// @param aLayerIndex index of aLayer in layers (layers above it might hide it)
+    /// @param aX,aY,aNumPixels the row
+    /// @param aStart,aEnd will be set to the range of pixels in the row (relative to aX) the layer can contribute to
+    /// @return false if layer does not contribute to the row at all
+    bool layerRowRange(const LayerInfo &aLayer, size_t aLayerIndex, int aX, int aY, int aNumPixels, int &aStart, int &aEnd);
+
   };
   typedef boost::intrusive_ptr<ViewStack> ViewStackPtr;
 
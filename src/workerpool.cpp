@@ -0,0 +1,124 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "workerpool.hpp"
+
+using namespace p44;
+
+
+// MARK: ===== WorkerPool
+
+WorkerPool::WorkerPool(int aNumWorkers) :
+  numJobs(0),
+  nextJob(0),
+  pendingJobs(0),
+  terminating(false)
+{
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&workAvailable, NULL);
+  pthread_cond_init(&allDone, NULL);
+  for (int i=0; i<aNumWorkers; ++i) {
+    pthread_t t;
+    if (pthread_create(&t, NULL, &WorkerPool::workerThreadStart, this)!=0) {
+      LOG(LOG_ERR, "WorkerPool: could not create worker thread #%d, continuing with %d workers", i, (int)workers.size());
+      break;
+    }
+    workers.push_back(t);
+  }
+}
+
+
+WorkerPool::~WorkerPool()
+{
+  pthread_mutex_lock(&mutex);
+  terminating = true;
+  pthread_cond_broadcast(&workAvailable);
+  pthread_mutex_unlock(&mutex);
+  for (std::vector<pthread_t>::iterator pos = workers.begin(); pos!=workers.end(); ++pos) {
+    pthread_join(*pos, NULL);
+  }
+  pthread_cond_destroy(&allDone);
+  pthread_cond_destroy(&workAvailable);
+  pthread_mutex_destroy(&mutex);
+}
+
+
+void WorkerPool::runJobs(int aNumJobs, WorkerJobCB aJob)
+{
+  if (aNumJobs<=0) return;
+  if (workers.empty() || aNumJobs==1) {
+    // nothing to parallelize, just run in this thread
+    for (int i=0; i<aNumJobs; ++i) aJob(i);
+    return;
+  }
+  pthread_mutex_lock(&mutex);
+  job = aJob;
+  numJobs = aNumJobs;
+  nextJob = 0;
+  pendingJobs = aNumJobs;
+  pthread_cond_broadcast(&workAvailable);
+  // calling thread works as well
+  runAvailableJobs();
+  // join: wait for jobs still running in worker threads
+  while (pendingJobs>0) {
+    pthread_cond_wait(&allDone, &mutex);
+  }
+  job = NULL;
+  numJobs = 0;
+  nextJob = 0;
+  pthread_mutex_unlock(&mutex);
+}
+
+
+void WorkerPool::runAvailableJobs()
+{
+  while (nextJob<numJobs) {
+    int j = nextJob++;
+    pthread_mutex_unlock(&mutex);
+    // Note: job cannot change before all pending jobs are done, so it's safe to call outside the lock
+    job(j);
+    pthread_mutex_lock(&mutex);
+    if (--pendingJobs==0) {
+      pthread_cond_signal(&allDone);
+    }
+  }
+}
+
+
+void *WorkerPool::workerThreadStart(void *aPool)
+{
+  static_cast<WorkerPool *>(aPool)->workerThread();
+  return NULL;
+}
+
+
+void WorkerPool::workerThread()
+{
+  pthread_mutex_lock(&mutex);
+  while (true) {
+    while (!terminating && nextJob>=numJobs) {
+      pthread_cond_wait(&workAvailable, &mutex);
+    }
+    if (terminating) break;
+    runAvailableJobs();
+  }
+  pthread_mutex_unlock(&mutex);
+}
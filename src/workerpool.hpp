@@ -0,0 +1,84 @@
+//
+//  Copyright (c) 2018 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of pixelboardd.
+//
+//  pixelboardd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  pixelboardd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with pixelboardd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __lethd_workerpool_hpp__
+#define __lethd_workerpool_hpp__
+
+#include "p44utils_common.hpp"
+
+#include <pthread.h>
+
+namespace p44 {
+
+  /// a job for the worker pool
+  /// @param aJobIndex index of the job, 0..numJobs-1
+  typedef boost::function<void (int aJobIndex)> WorkerJobCB;
+
+  /// Small pool of threads to run a number of independent jobs in parallel, and wait for all of them
+  /// to complete (e.g. render multiple display panels at the same time)
+  /// @note the jobs must not access anything that is not safe to use from other threads, in particular
+  ///   not the mainloop, and must not start timers or call completion callbacks
+  class WorkerPool : public P44Obj
+  {
+    pthread_mutex_t mutex; ///< protects all job state
+    pthread_cond_t workAvailable; ///< signalled when new jobs are available or pool terminates
+    pthread_cond_t allDone; ///< signalled when the last pending job of a batch is done
+    std::vector<pthread_t> workers;
+
+    WorkerJobCB job; ///< the job to run
+    int numJobs; ///< number of jobs in current batch
+    int nextJob; ///< index of next job to be started
+    int pendingJobs; ///< number of jobs not yet completed
+    bool terminating;
+
+  public:
+
+    /// create pool
+    /// @param aNumWorkers number of worker threads. Note that the thread calling runJobs()
+    ///   also runs jobs, so 1 worker thread already allows 2 jobs to run in parallel.
+    WorkerPool(int aNumWorkers);
+
+    /// stops and joins all worker threads
+    virtual ~WorkerPool();
+
+    /// @return number of worker threads
+    int numWorkers() { return (int)workers.size(); }
+
+    /// run jobs in parallel and wait until all of them are complete
+    /// @param aNumJobs number of jobs
+    /// @param aJob will be called once for each job index 0..aNumJobs-1, possibly from different threads
+    void runJobs(int aNumJobs, WorkerJobCB aJob);
+
+  private:
+
+    static void *workerThreadStart(void *aPool);
+    void workerThread();
+
+    /// run jobs of the current batch as long as there are any
+    /// @note mutex must be locked when calling this, and is locked again on return
+    void runAvailableJobs();
+
+  };
+  typedef boost::intrusive_ptr<WorkerPool> WorkerPoolPtr;
+
+} // namespace p44
+
+#endif /* __lethd_workerpool_hpp__ */